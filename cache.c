@@ -0,0 +1,338 @@
+/* cache.c -- on-disk cache of parsed scripts ($Revision: 1.1 $) */
+
+#define	REQUIRE_STAT	1
+#define	REQUIRE_FCNTL	1
+
+#include "es.h"
+#include "gc.h"
+#include "input.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+/*
+ * parse cache
+ *	if $parsecache names a directory, a script run from a file is
+ *	cached there as it is parsed.  each top-level command is encoded
+ *	into a compact form as it comes out of the parser, and when the
+ *	whole file has been parsed without error the encoding is written
+ *	to the directory.  the next time the same file is run, if its
+ *	device, inode, size and modification time have not changed, the
+ *	commands are decoded from the cache instead of being lexed and
+ *	parsed again.
+ *
+ *	a cache file is a Header, which also identifies the build of
+ *	the parser that wrote it, followed by one encoded tree for each
+ *	value $&parse returned.  a tree is its node kind in one byte
+ *	(NONODE for a null pointer) followed by its string, as a length
+ *	and bytes, or by its subtrees.
+ */
+
+#define	CACHEMAGIC	"es-parse"
+#define	CACHEVERSION	2
+#define	NONODE		0xff
+
+typedef struct {
+	char magic[8];
+	uint32_t version, kinds, build, unused;
+	uint64_t dev, ino, size, mtime, mtimensec;
+} Header;
+
+/* buildid -- a hash of what this shell's parser turns source into */
+static uint32_t buildid(void) {
+	static uint32_t id = 0;
+	if (id == 0) {
+		const char *s;
+		id = 2166136261u ^ sizeof (Tree);
+		for (s = buildstamp; *s != '\0'; s++)
+			id = (id ^ (unsigned char) *s) * 16777619u;
+	}
+	return id;
+}
+
+/*
+ * cachepath -- the name of the cache file for a script, or NULL.  the
+ *	script's full path is flattened into one name by turning each /
+ *	into %; a % or @ in the path is escaped with an @, so that no two
+ *	scripts share a cache file.
+ */
+static char *cachepath(const char *name) {
+	char *s, *dir, real[PATH_MAX];
+	Buffer *buf;
+	List *var = varlookup("parsecache", NULL);
+
+#if HAVE_REALPATH
+	if (var == NULL || realpath(name, real) == NULL)
+		return NULL;
+#else
+	if (var == NULL || !isabsolute((char *) name) || strlen(name) >= sizeof real)
+		return NULL;
+	strcpy(real, name);
+#endif
+	dir = str("%L", var, " ");
+	if (*dir == '\0')
+		return NULL;
+	buf = openbuffer(0);
+	for (s = real; *s != '\0'; s++)
+		if (*s == '/')
+			buf = bufputc(buf, '%');
+		else {
+			if (*s == '%' || *s == '@')
+				buf = bufputc(buf, '@');
+			buf = bufputc(buf, *s);
+		}
+	buf = bufputc(buf, '\0');
+	s = str("%s/%s", dir, buf->str);
+	freebuffer(buf);
+	return s;
+}
+
+/* fillheader -- describe the file open on fd */
+static Boolean fillheader(Header *h, int fd) {
+	struct stat st;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+		return FALSE;
+	memzero(h, sizeof (Header));
+	memcpy(h->magic, CACHEMAGIC, sizeof h->magic);
+	h->version = CACHEVERSION;
+	h->kinds = nPipe;
+	h->build = buildid();
+	h->dev = st.st_dev;
+	h->ino = st.st_ino;
+	h->size = st.st_size;
+	h->mtime = st.st_mtime;
+#if HAVE_STRUCT_STAT_ST_MTIM
+	h->mtimensec = st.st_mtim.tv_nsec;
+#endif
+	return TRUE;
+}
+
+
+/*
+ * encoding
+ */
+
+static Buffer *putlength(Buffer *buf, size_t len) {
+	for (; len >= 0x80; len >>= 7)
+		buf = bufputc(buf, (len & 0x7f) | 0x80);
+	return bufputc(buf, len);
+}
+
+static Buffer *puttree(Buffer *buf, Tree *t) {
+	size_t len;
+
+	if (t == NULL)
+		return bufputc(buf, NONODE);
+	buf = bufputc(buf, t->kind);
+	switch (t->kind) {
+	    case nWord: case nQword: case nPrim:
+		len = strlen(t->u[0].s);
+		buf = putlength(buf, len);
+		return bufncat(buf, t->u[0].s, len);
+	    case nCall: case nThunk: case nVar:
+		return puttree(buf, t->u[0].p);
+	    case nAssign:  case nConcat: case nClosure: case nFor:
+	    case nLambda: case nLet: case nList:  case nLocal:
+	    case nVarsub: case nMatch: case nExtract:
+		buf = puttree(buf, t->u[0].p);
+		return puttree(buf, t->u[1].p);
+	    default:
+		panic("puttree: bad node kind %d", t->kind);
+	}
+	NOTREACHED;
+}
+
+
+/*
+ * decoding
+ *	a cache is checked completely when it is loaded, so that the
+ *	trees can be built later without further checks.
+ */
+
+static Boolean getlength(const unsigned char **sp, const unsigned char *end, size_t *lenp) {
+	const unsigned char *s = *sp;
+	size_t len = 0;
+	int shift;
+
+	for (shift = 0; s < end && shift < 64; shift += 7) {
+		len |= (size_t) (*s & 0x7f) << shift;
+		if ((*s++ & 0x80) == 0) {
+			*sp = s;
+			*lenp = len;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* checktree -- skip over one encoded tree, or return NULL if it is malformed */
+static const unsigned char *checktree(const unsigned char *s, const unsigned char *end, int depth) {
+	size_t len;
+
+	if (s >= end || depth > 10000)
+		return NULL;
+	switch (*s++) {
+	    case NONODE:
+		return s;
+	    case nWord: case nQword: case nPrim:
+		if (!getlength(&s, end, &len) || len > (size_t) (end - s) || memchr(s, '\0', len) != NULL)
+			return NULL;
+		return s + len;
+	    case nCall: case nThunk: case nVar:
+		return checktree(s, end, depth + 1);
+	    case nAssign:  case nConcat: case nClosure: case nFor:
+	    case nLambda: case nLet: case nList:  case nLocal:
+	    case nVarsub: case nMatch: case nExtract:
+		if ((s = checktree(s, end, depth + 1)) == NULL)
+			return NULL;
+		return checktree(s, end, depth + 1);
+	    default:
+		return NULL;
+	}
+}
+
+/* gettree -- decode a checked tree into gc space; collection is disabled */
+static Tree *gettree(const unsigned char **sp) {
+	const unsigned char *s = *sp;
+	NodeKind kind;
+	size_t len = 0;
+	Tree *t, *t0;
+
+	if (*s == NONODE) {
+		*sp = s + 1;
+		return NULL;
+	}
+	kind = *s++;
+	switch (kind) {
+	    case nWord: case nQword: case nPrim:
+		getlength(&s, s + 10, &len);
+		t = gcmk(kind, gcndup((const char *) s, len));
+		s += len;
+		break;
+	    case nCall: case nThunk: case nVar:
+		t = gcmk(kind, gettree(&s));
+		break;
+	    default:
+		t0 = gettree(&s);
+		t = gcmk(kind, t0, gettree(&s));
+		break;
+	}
+	*sp = s;
+	return t;
+}
+
+
+/*
+ * the interface to the input routines
+ */
+
+/* loadcache -- replay a valid cache for the file, or return FALSE */
+static Boolean loadcache(Input *in, const char *path, Header *h) {
+	int fd;
+	long n;
+	struct stat st;
+	Header old;
+	const unsigned char *s, *end;
+
+	if ((fd = eopen((char *) path, oOpen)) == -1)
+		return FALSE;
+	if (
+		fstat(fd, &st) == -1
+	     || st.st_uid != geteuid()
+	     || st.st_size < (off_t) sizeof (Header)
+	     || read(fd, &old, sizeof old) != (long) sizeof old
+	     || memcmp(&old, h, sizeof (Header)) != 0
+	) {
+		close(fd);
+		return FALSE;
+	}
+	in->cachelen = st.st_size - sizeof (Header);
+	in->cache = ealloc(in->cachelen + 1);
+	n = read(fd, in->cache, in->cachelen);
+	close(fd);
+
+	s = in->cache;
+	end = s + in->cachelen;
+	if (n == (long) in->cachelen)
+		while (s != NULL && s < end)
+			s = checktree(s, end, 0);
+	if (s != end) {
+		efree(in->cache);
+		in->cache = NULL;
+		return FALSE;
+	}
+	in->cachepos = in->cache;
+	return TRUE;
+}
+
+/*
+ * opencache -- set up the cache for a script being run from fd:  either
+ *	replay the commands from a valid cache, or record them for one.
+ */
+extern void opencache(Input *in) {
+	Header h;
+	char *path;
+
+	if (
+		in->shared || !in->readahead
+	     || (in->runflags & (run_interactive|run_noexec|run_echoinput|run_printcmds|run_lisptrees))
+	     || (path = cachepath(in->name)) == NULL
+	     || !fillheader(&h, in->fd)
+	     || loadcache(in, path, &h)
+	)
+		return;
+	in->cachename = ealloc(strlen(path) + 1);
+	strcpy(in->cachename, path);
+	in->record = bufncat(openbuffer(0), (char *) &h, sizeof h);
+}
+
+/* cachenext -- the next command from a replayed cache, or FALSE at the end */
+extern Boolean cachenext(Input *in, Tree **treep) {
+	if (in->cachepos == in->cache + in->cachelen)
+		return FALSE;
+	gcdisable();
+	Ref(Tree *, tree, gettree((const unsigned char **) &in->cachepos));
+	gcenable();
+	*treep = tree;
+	RefEnd(tree);
+	return TRUE;
+}
+
+/* cacherecord -- add a command to the cache being recorded */
+extern void cacherecord(Input *in, Tree *tree) {
+	in->record = puttree(in->record, tree);
+}
+
+/* savecache -- write out a recorded cache, after a clean end of file */
+extern void savecache(Input *in) {
+	int fd;
+	char *tmp;
+
+	if (in->record == NULL)
+		return;
+	tmp = str("%s.%d", in->cachename, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (fd != -1) {
+		Boolean ok = write(fd, in->record->str, in->record->current) == (long) in->record->current;
+		if (close(fd) == -1 || !ok || rename(tmp, in->cachename) == -1)
+			unlink(tmp);
+	}
+	closecache(in);
+}
+
+/* closecache -- discard any cache state */
+extern void closecache(Input *in) {
+	if (in->record != NULL) {
+		freebuffer(in->record);
+		in->record = NULL;
+	}
+	if (in->cachename != NULL) {
+		efree(in->cachename);
+		in->cachename = NULL;
+	}
+	if (in->cache != NULL) {
+		efree(in->cache);
+		in->cache = NULL;
+	}
+}
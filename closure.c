@@ -31,18 +31,14 @@ static size_t ClosureScan(void *p) {
 	return sizeof (Closure);
 }
 
-/* revtree -- destructively reverse a list stored in a tree */
+/* revtree -- reverse a list stored in a tree, copying it since trees may be shared */
 static Tree *revtree(Tree *tree) {
-	Tree *prev, *next;
-	if (tree == NULL)
-		return NULL;
-	prev = NULL;
-	do {
+	Tree *prev = NULL;
+	assert(gcisblocked());
+	for (; tree != NULL; tree = tree->u[1].p) {
 		assert(tree->kind == nList);
-		next = tree->u[1].p;
-		tree->u[1].p = prev;
-		prev = tree;
-	} while ((tree = next) != NULL);
+		prev = gcmk(nList, tree->u[0].p, prev);
+	}
 	return prev;
 }
 
@@ -106,7 +106,7 @@ static Assoc *get(Dict *dict, const char *name) {
 	Assoc *ap;
 	unsigned long n = strhash(name), mask = dict->size - 1;
 	for (; (ap = &dict->table[n & mask])->name != NULL; n++)
-		if (ap->name != DEAD && streq(name, ap->name))
+		if (ap->name == name || (ap->name != DEAD && streq(name, ap->name)))
 			return ap;
 	return NULL;
 }
@@ -218,3 +218,56 @@ extern void *dictget2(Dict *dict, const char *name1, const char *name2) {
 			return ap->value;
 	return NULL;
 }
+
+
+/*
+ * atoms -- immortal, shared copies of short strings
+ *	the parser stores the words it uses as names -- of variables,
+ *	functions and bindings -- as atoms, so the same name used in many
+ *	places is one string, and comparisons between names taken from
+ *	programs usually succeed on pointer equality.  atoms live outside
+ *	the garbage collector's spaces and are never freed, so other words,
+ *	which a long script may have without end, are not made atoms.
+ */
+
+#define	ATOM_MAX	64
+#define	INIT_ATOM_SIZE	512
+
+static char **atoms = NULL;
+static unsigned long natoms = 0, atomsize = 0;
+
+/* atomslot -- find the slot holding (or to hold) a string in an atom table */
+static char **atomslot(char **table, unsigned long size, const char *s) {
+	unsigned long n = strhash(s), mask = size - 1;
+	for (; table[n & mask] != NULL; n++)
+		if (streq(table[n & mask], s))
+			break;
+	return &table[n & mask];
+}
+
+/* atom -- return the shared copy of a string, or NULL if it is too long */
+extern char *atom(const char *s) {
+	char **slot;
+	size_t len = strlen(s);
+	if (len >= ATOM_MAX)
+		return NULL;
+	if (REMAIN(atomsize) <= natoms) {
+		unsigned long i, size = atomsize == 0 ? INIT_ATOM_SIZE : GROW(atomsize);
+		char **table = ealloc(size * sizeof (char *));
+		memzero(table, size * sizeof (char *));
+		for (i = 0; i < atomsize; i++)
+			if (atoms[i] != NULL)
+				*atomslot(table, size, atoms[i]) = atoms[i];
+		if (atoms != NULL)
+			efree(atoms);
+		atoms = table;
+		atomsize = size;
+	}
+	slot = atomslot(atoms, atomsize, s);
+	if (*slot == NULL) {
+		*slot = ealloc(len + 1);
+		memcpy(*slot, s, len + 1);
+		natoms++;
+	}
+	return *slot;
+}
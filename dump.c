@@ -30,9 +30,13 @@
  *
  * in order that addresses are internally consistent, garbage collection
  * is disabled during the dumping process.
+ *
+ * nPrim trees are the exception to the read-only rule:  the addresses
+ * of the primitives are not known until the program is linked, so
+ * those nodes are left writable and resolved by runinitial().
  */
 
-static Dict *cvars, *strings;
+static Dict *cvars, *strings, *primtrees;
 
 static Boolean allprintable(const char *s) {
 	int c;
@@ -154,10 +158,15 @@ static char *dumptree(Tree *tree) {
 		switch (tree->kind) {
 		    default:
 			panic("dumptree: bad node kind %d", tree->kind);
-		    case nWord: case nQword: case nPrim:
+		    case nWord: case nQword:
 			print("static const Tree_s %s = { n%s, { { (char *) %s } } };\n",
 			      name + 1, nodename(tree->kind), dumpstring(tree->u[0].s));
 			break;
+		    case nPrim:
+			print("static Tree_sp %s = { n%s, { { (char *) %s } }, NULL };\n",
+			      name + 1, nodename(tree->kind), dumpstring(tree->u[0].s));
+			primtrees = dictput(primtrees, name, tree);
+			break;
 		    case nCall: case nThunk: case nVar:
 			print("static const Tree_p %s = { n%s, { { (Tree *) %s } } };\n",
 			      name + 1, nodename(tree->kind), dumptree(tree->u[0].p));
@@ -248,6 +257,10 @@ static void dumpvar(void UNUSED *ignore, char *key, void *value) {
 	dumplist(var->defn);
 }
 
+static void dumpprimtree(void UNUSED *ignore, char *key, void UNUSED *value) {
+	print("\t(Tree *) %s,\n", key);
+}
+
 static void dumpdef(char *name, Var *var) {
 	print("\t{ %s, (const List *) %s },\n", dumpstring(name), dumplist(var->defn));
 }
@@ -270,7 +283,8 @@ static void dumpvariables(void UNUSED *ignore, char *key, void *value) {
 #define TreeTypes \
 	typedef struct { NodeKind k; struct { char *s; } u[1]; } Tree_s; \
 	typedef struct { NodeKind k; struct { Tree *p; } u[1]; } Tree_p; \
-	typedef struct { NodeKind k; struct { Tree *p; } u[2]; } Tree_pp;
+	typedef struct { NodeKind k; struct { Tree *p; } u[2]; } Tree_pp; \
+	typedef struct { NodeKind k; struct { char *s; } u[1]; Prim *prim; } Tree_sp;
 TreeTypes
 #define	PPSTRING(s)	STRING(s)
 
@@ -280,6 +294,8 @@ static void printheader(List *title) {
 		|| offsetof(Tree, u[0].p) != offsetof(Tree_p,  u[0].p)
 		|| offsetof(Tree, u[0].p) != offsetof(Tree_pp, u[0].p)
 		|| offsetof(Tree, u[1].p) != offsetof(Tree_pp, u[1].p)
+		|| offsetof(Tree, u[0].s) != offsetof(Tree_sp, u[0].s)
+		|| offsetof(Tree, u[1].prim) != offsetof(Tree_sp, prim)
 	)
 		panic("dumpstate: Tree union sizes do not match struct sizes");
 
@@ -294,6 +310,7 @@ extern void runinitial(void) {
 
 	cvars = mkdict();
 	strings = mkdict();
+	primtrees = mkdict();
 
 	printheader(title);
 	dictforall(vars, dumpvar, NULL);
@@ -306,8 +323,15 @@ extern void runinitial(void) {
 	print("\t{ NULL, NULL }\n");
 	print("};\n\n");
 
+	print("\nstatic Tree *const prims[] = {\n");
+	dictforall(primtrees, dumpprimtree, NULL);
+	print("\tNULL\n");
+	print("};\n\n");
+
 	print("\nextern void runinitial(void) {\n");
 	print("\tint i;\n");
+	print("\tfor (i = 0; prims[i] != NULL; i++)\n");
+	print("\t\tprims[i]->u[1].prim = lookupprim(prims[i]->u[0].s);\n");
 	print("\tfor (i = 0; defs[i].name != NULL; i++)\n");
 	print("\t\tvardef((char *) defs[i].name, NULL, (List *) defs[i].value);\n");
 	print("}\n");
@@ -20,6 +20,7 @@ typedef struct Term Term;
 typedef struct List List;
 typedef struct Binding Binding;
 typedef struct Closure Closure;
+typedef struct Prim Prim;
 
 struct List {
 	Term *term;
@@ -54,6 +55,7 @@ struct Tree {
 		Tree *p;
 		char *s;
 		int i;
+		Prim *prim;
 	} u[2];
 };
 
@@ -88,22 +90,43 @@ extern Boolean gcverbose;		/* -G */
 extern Boolean gcinfo;			/* -I */
 #endif
 
+extern const char *startuptimes;	/* $ES_STARTUP_TIMES */
+extern const char *startphase(const char *name);
+extern void nextcommand(void);
+extern void reportphases(void);
+#define	PHASE(name)	STMT(if (startuptimes != NULL) startphase(name))
+
+
+/* server.c */
+
+extern char **serve(const char *path, int *argcp);
+extern void client(const char *path, int argc, char **argv);
+
 
 /* initial.c (for es) or dump.c (for esdump) */
 
 extern void runinitial(void);
 
 
+/* image.c */
+
+extern void dumpimage(const char *file);
+extern void loadimage(const char *file);
+
+
 /* fd.c */
 
 extern void mvfd(int old, int new);
 extern int newfd(void);
+extern int anonfile(const char *name);
+extern int cloexecpipe(int p[2]);
 
 #define	UNREGISTERED	(-999)
 extern void registerfd(int *fdp, Boolean closeonfork);
 extern void unregisterfd(int *fdp);
 extern void releasefd(int fd);
 extern void closefds(void);
+extern Boolean spawnfds(void (*dupfd)(void *, int, int), void (*closefd)(void *, int), void *arg);
 
 extern int fdmap(int fd);
 extern int defer_mvfd(Boolean parent, int old, int new);
@@ -117,6 +140,7 @@ extern Term *mkterm(char *str, Closure *closure);
 extern Term *mkstr(char *str);
 extern char *getstr(Term *term);
 extern Closure *getclosure(Term *term);
+extern Boolean iscodestring(const char *s);
 extern Term *termcat(Term *t1, Term *t2);
 extern Boolean termeq(Term *term, const char *s);
 extern Boolean isclosure(Term *term);
@@ -137,6 +161,9 @@ extern List *sortlist(List *list);
 /* tree.c */
 
 extern Tree *gcmk(NodeKind VARARGS);	/* gcalloc a tree node */
+#if HASHCONS
+extern Tree *sharetree(Tree *tree);	/* share identical sealed subtrees */
+#endif
 
 
 /* closure.c */
@@ -151,6 +178,7 @@ extern Binding *reversebindings(Binding *binding);
 
 extern Binding *bindargs(Tree *params, List *args, Binding *binding);
 extern List *forkexec(char *file, List *list, Boolean inchild);
+extern List *externalcommand(Term *term, char **filep);
 extern List *walk(Tree *tree, Binding *binding, int flags);
 extern List *eval(List *list, Binding *binding, int flags);
 extern List *eval1(Term *term, int flags);
@@ -189,10 +217,13 @@ extern List *extractmatches(List *subjects, List *patterns, StrList *quotes);
 extern void initvars(void);
 extern void initenv(char **envp, Boolean protected);
 extern void hidevariables(void);
+extern Boolean isinternal(const char *name);
 extern void validatevar(const char *var);
 extern List *varlookup(const char *name, Binding *binding);
 extern List *varlookup2(char *name1, char *name2, Binding *binding);
 extern void vardef(char *, Binding *, List *);
+extern List *varappend(char *, Binding *, List *);
+extern List *varindex(const char *, Binding *, List *, int);
 extern Vector *mkenv(void);
 extern void setnoexport(List *list);
 extern void addtolist(void *arg, char *key, void *value);
@@ -211,6 +242,7 @@ extern List *ltrue, *lfalse;
 extern Boolean istrue(List *status);
 extern int exitstatus(List *status);
 extern char *mkstatus(int status);
+extern Term *mkstatusterm(int status);
 extern void printstatus(int pid, int status);
 
 
@@ -223,17 +255,23 @@ extern char *checkexecutable(char *file);
 
 extern Boolean hasforked;
 extern int efork(Boolean parent, Boolean background);
+#if HAVE_POSIX_SPAWN
+extern int espawn(char *file, char **argv, char **envp, int *moves);
+#endif
 extern pid_t spgrp(pid_t pgid);
 extern int tctakepgrp(void);
 extern void initpgrp(void);
 extern int ewait(int pid, Boolean interruptible);
+#if HAVE_WAIT4
+extern void jobtimes(intmax_t *user_usec, intmax_t *sys_usec);
+#endif
 #define	ewaitfor(pid)	ewait(pid, FALSE)
 
 #if JOB_PROTECT
 extern void tcreturnpgrp(void);
 extern Noreturn esexit(int);
 #else
-#define	esexit(n)	(exit(n))
+#define	esexit(n)	(exit(exitflush(n)))
 #endif
 
 
@@ -245,6 +283,7 @@ extern void dictforall(Dict *dict, void (*proc)(void *, char *, void *), void *a
 extern void *dictget(Dict *dict, const char *name);
 extern Dict *dictput(Dict *dict, char *name, void *value);
 extern void *dictget2(Dict *dict, const char *name1, const char *name2);
+extern char *atom(const char *s);
 
 
 /* conv.c */
@@ -257,6 +296,10 @@ extern void initconv(void);
 extern int print(const char *fmt VARARGS);
 extern int eprint(const char *fmt VARARGS);
 extern int fprint(int fd, const char *fmt VARARGS);
+extern void flushout(void);
+extern void quietflush(void);
+extern int exitflush(int status);
+extern Boolean sigflush(int sig);
 extern Noreturn panic(const char *fmt VARARGS);
 
 
@@ -315,6 +358,8 @@ extern List *esoptend(void);
 /* prim.c */
 
 extern List *prim(char *s, List *list, int evalflags);
+extern List *primcall(Tree *tree, List *list, int evalflags);
+extern Prim *lookupprim(const char *s);
 extern void initprims(void);
 extern List *primswithprefix(const char *prefix);
 
@@ -325,12 +370,14 @@ extern void startsplit(const char *sep, Boolean coalesce);
 extern void splitstring(char *in, size_t len, Boolean endword);
 extern List *endsplit(void);
 extern List *fsplit(const char *sep, List *list, Boolean coalesce);
+extern List *splitall(const char *sep, const char *in, size_t len, Boolean coalesce);
 
 
 /* signal.c */
 
 extern int signumber(const char *name);
 extern char *signame(int sig);
+extern Term *sigterm(int sig);
 extern char *sigmessage(int sig);
 
 #define	SIGCHK() sigchk()
@@ -349,6 +396,7 @@ extern void sigchk(void);
 extern Boolean issilentsignal(List *e);
 extern void exitonsignal(List *e);
 extern void setsigdefaults(void);
+extern void getsigdefaults(sigset_t *set);
 extern void blocksignals(void);
 extern void unblocksignals(void);
 
@@ -363,6 +411,7 @@ extern int opentty(void);
 /* version.c */
 
 extern const List * const version;
+extern const char buildstamp[];
 
 
 /* gc.c -- see gc.h for more */
@@ -380,6 +429,8 @@ extern void gcreserve(size_t nbytes);		/* provoke a collection, if enabled and n
 extern void gcenable(void);			/* enable collections */
 extern void gcdisable(void);			/* disable collections */
 extern Boolean gcisblocked(void);		/* is collection disabled? */
+extern size_t gcallocated(void);		/* bytes allocated so far */
+extern int gccollections(void);			/* collections so far */
 
 /* operations with pspace, the explicitly-collected gc space for parse tree building */
 extern void *createpspace(void);
@@ -70,6 +70,11 @@
  *		is on.  (it's been reported that SCO does not have lstat, but
  *		is this true even for recent versions?)
  *
+ *	HASHCONS
+ *		if this is on, the default, parse trees are hash-consed as
+ *		they are sealed:  structurally identical subtrees of all
+ *		live trees share a single node.
+ *
  *	INITIAL_PATH
  *		this is the default value for $path (and $PATH) when the shell
  *		starts up.  it is replaced by one from the environment if it
@@ -291,6 +296,10 @@
 #define	GCVERBOSE		0
 #endif
 
+#ifndef	HASHCONS
+#define	HASHCONS		1
+#endif
+
 #ifndef	INITIAL_PATH
 #define	INITIAL_PATH		"/usr/ucb", "/usr/bin", "/bin", ""
 #endif
@@ -28,10 +28,17 @@ extern List *forkexec(char *file, List *list, Boolean inchild) {
 	Vector *env;
 	gcdisable();
 	env = mkenv();
-	pid = efork(!inchild, FALSE);
+	pid = 0;
+#if HAVE_POSIX_SPAWN
+	if (!inchild && varlookup("fn-%exec-failure", NULL) == NULL)
+		pid = espawn(file, vectorize(list)->vector, env->vector, NULL);
+#endif
 	if (pid == 0) {
-		execve(file, vectorize(list)->vector, env->vector);
-		failexec(file, list);
+		pid = efork(!inchild, FALSE);
+		if (pid == 0) {
+			execve(file, vectorize(list)->vector, env->vector);
+			failexec(file, list);
+		}
 	}
 	gcenable();
 	status = ewaitfor(pid);
@@ -42,11 +49,61 @@ extern List *forkexec(char *file, List *list, Boolean inchild) {
 	} else
 		SIGCHK();
 	printstatus(0, status);
-	return mklist(mkterm(mkstatus(status), NULL), NULL);
+	return mklist(mkstatusterm(status), NULL);
+}
+
+/* hascall -- can globbing this tree run a command? */
+static Boolean hascall(Tree *tree) {
+	for (; tree != NULL; tree = tree->u[1].p)
+		switch (tree->kind) {
+		    case nWord: case nQword: case nPrim: case nThunk: case nLambda:
+			return FALSE;
+		    case nVar:
+			return hascall(tree->u[0].p);
+		    case nCall:
+			return TRUE;
+		    case nVarsub: case nConcat: case nList:
+			if (hascall(tree->u[0].p))
+				return TRUE;
+			break;
+		    default:
+			return TRUE;
+		}
+	return FALSE;
+}
+
+/* selfappend -- is this `var = $var items', where items can't change var? */
+static Boolean selfappend(Tree *varform, Tree *valueform) {
+	Tree *t;
+	if (varform == NULL || varform->kind != nWord
+	    || valueform == NULL || valueform->kind != nList)
+		return FALSE;
+	t = valueform->u[0].p;
+	if (t->kind != nVar || (t = t->u[0].p)->kind != nWord)
+		return FALSE;
+	return streq(t->u[0].s, varform->u[0].s) && !hascall(valueform->u[1].p);
+}
+
+/* appendassign -- assign `var = $var items', extending var in place if possible */
+static List *appendassign(char *name0, Tree *itemform, Binding *binding0) {
+	Ref(List *, result, NULL);
+	Ref(char *, name, name0);
+	Ref(Binding *, binding, binding0);
+	Ref(List *, items, glom(itemform, binding, TRUE));
+	result = varappend(name, binding, items);
+	if (result == NULL) {
+		result = append(varlookup(name, binding), items);
+		vardef(name, binding, result);
+	}
+	RefEnd3(items, binding, name);
+	RefReturn(result);
 }
 
 /* assign -- bind a list of values to a list of variables */
 static List *assign(Tree *varform, Tree *valueform0, Binding *binding0) {
+	if (selfappend(varform, valueform0))
+		return appendassign(varform->u[0].s, valueform0->u[1].p, binding0);
+
 	Ref(List *, result, NULL);
 
 	Ref(Tree *, valueform, valueform0);
@@ -263,6 +320,40 @@ static List *extractpattern(Tree *subjectform0, Tree *patternform0,
 	RefReturn(result);
 }
 
+/* seqthunk -- the thunk passed as an argument to %seq, or NULL if it isn't one */
+static Tree *seqthunk(Tree *t) {
+	for (; t != NULL && t->kind == nList && t->u[1].p == NULL; t = t->u[0].p)
+		;
+	return (t != NULL && t->kind == nThunk) ? t : NULL;
+}
+
+/* isseqcall -- is this a literal call of %seq with only thunks as arguments? */
+static Boolean isseqcall(Tree *tree) {
+	Tree *t = tree->u[0].p;
+	if (t == NULL || t->kind != nWord || !streq(t->u[0].s, "%seq"))
+		return FALSE;
+	if ((t = tree->u[1].p) == NULL)
+		return FALSE;
+	for (; t != NULL; t = t->u[1].p)
+		if (t->kind != nList || seqthunk(t->u[0].p) == NULL)
+			return FALSE;
+	return TRUE;
+}
+
+/* isdefaultseq -- is %seq still bound to $&seq? */
+static Boolean isdefaultseq(Binding *binding) {
+	static Prim *seq = NULL;
+	Closure *cp;
+	List *fn = varlookup("fn-%seq", binding);
+	if (fn == NULL || fn->next != NULL)
+		return FALSE;
+	if ((cp = getclosure(fn->term)) == NULL || cp->tree->kind != nPrim)
+		return FALSE;
+	if (seq == NULL)
+		seq = lookupprim("seq");
+	return cp->tree->u[1].prim == seq;
+}
+
 /* walk -- walk through a tree, evaluating nodes */
 extern List *walk(Tree *tree0, Binding *binding0, int flags) {
 	Tree *volatile tree = tree0;
@@ -276,7 +367,32 @@ top:
 
 	switch (tree->kind) {
 
-	    case nConcat: case nList: case nQword: case nVar: case nVarsub:
+	    case nList:
+		/*
+		 * while fn-%seq is the default, walk the commands of a
+		 * sequence in place rather than building a closure for
+		 * each one and dispatching through $&seq; the -e case
+		 * is left to $&seq, which checks every command.
+		 */
+		if (!(flags & eval_exitonfalse) && isseqcall(tree)) {
+			Boolean inplace;
+			Ref(Tree *, tp, tree);
+			Ref(Binding *, bp, binding);
+			inplace = isdefaultseq(bp);
+			if (inplace) {
+				for (tp = tp->u[1].p; tp->u[1].p != NULL; tp = tp->u[1].p)
+					walk(seqthunk(tp->u[0].p)->u[0].p, bp,
+					     flags &~ eval_inchild);
+				tp = seqthunk(tp->u[0].p)->u[0].p;
+			}
+			tree = tp;
+			binding = bp;
+			RefEnd2(bp, tp);
+			if (inplace)
+				goto top;
+		}
+		FALLTHROUGH;
+	    case nConcat: case nQword: case nVar: case nVarsub:
 	    case nWord: case nThunk: case nLambda: case nCall: case nPrim: {
 		List *list;
 		Ref(Binding *, bp, binding);
@@ -358,6 +474,67 @@ extern List *pathsearch(Term *term) {
 	return eval(list, NULL, 0);
 }
 
+/* resolvecommand -- the program eval() would exec for list, if any */
+static List *resolvecommand(List *list0, Binding *binding, char **filep) {
+	if (list0 == NULL || getclosure(list0->term) != NULL)
+		return NULL;
+
+	Ref(List *, list, list0);
+	Ref(char *, name, getstr(list->term));
+	if (varlookup2("fn-", name, binding) != NULL)
+		list = NULL;
+	else if (isabsolute(name)) {
+		if (checkexecutable(name) == NULL)
+			*filep = name;
+		else
+			list = NULL;
+	} else if (!isinternal("fn-%pathsearch"))
+		/* a user's %pathsearch may have effects; run it in the child */
+		list = NULL;
+	else {
+		List *fn = pathsearch(list->term);
+		if (fn != NULL && fn->next == NULL && getclosure(fn->term) == NULL)
+			*filep = getstr(fn->term);
+		else
+			list = NULL;
+	}
+	RefEnd(name);
+	RefReturn(list);
+}
+
+/*
+ * externalcommand -- if evaluating term would only run an external
+ *	program, return its arguments and set *filep to the program.
+ *	nothing but the initial %pathsearch is run to find out; NULL
+ *	means the caller should evaluate term in the usual way.
+ */
+extern List *externalcommand(Term *term, char **filep) {
+	Closure *cp;
+	List *volatile list = NULL;
+
+	if (varlookup("fn-%exec-failure", NULL) != NULL)
+		return NULL;
+	ExceptionHandler
+		if ((cp = getclosure(term)) == NULL) {
+			list = mklist(term, NULL);
+			list = resolvecommand(list, NULL, filep);
+		} else if (cp->tree->kind == nThunk) {
+			Tree *body = cp->tree->u[0].p;
+			if (body != NULL && body->kind == nList && !hascall(body)) {
+				Ref(Binding *, binding, cp->binding);
+				list = glom(body, binding, TRUE);
+				list = resolvecommand(list, binding, filep);
+				RefEnd(binding);
+			}
+		}
+	CatchException (e)
+		if (!termeq(e->term, "error"))
+			throw(e);
+		list = NULL;
+	EndExceptionHandler
+	return list;
+}
+
 /* eval -- evaluate a list, producing a list */
 extern List *eval(List *list0, Binding *binding0, int flags) {
 	Closure *volatile cp;
@@ -383,7 +560,7 @@ restart:
 		switch (cp->tree->kind) {
 		    case nPrim:
 			assert(cp->binding == NULL);
-			list = prim(cp->tree->u[0].s, list->next, flags);
+			list = primcall(cp->tree, list->next, flags);
 			break;
 		    case nThunk:
 			list = walk(cp->tree->u[0].p, cp->binding, flags);
@@ -0,0 +1,45 @@
+#
+# batchbench.es -- measure batch shell throughput in commands per second
+#
+# Usage: es batchbench.es [count [shell]]
+#
+# Generates a script of count (default 200000) small commands, the kind
+# of flat, machine-written script that configuration tools emit, and runs
+# it with shell (default es) both as a file argument and on standard
+# input.  The rate is computed from user+system time, as reported by the
+# time builtin, so it measures the shell rather than the disk.
+#
+
+let (
+	count = <={if {~ $#* 0} {result 200000} {result $1}}
+	shell = <={if {~ $#* 0 1} {result es} {result $2}}
+	script = /tmp/batchbench-$pid.es
+) {
+	awk 'BEGIN {
+		for (i = 0; i < '^$count^'; i += 4) {
+			print "x = " i " y z"
+			print "result $x " i
+			print "if {~ $x " i "} {y = ($x)} {y = ()}"
+			print "let (a = $y) result $a"
+		}
+	}' > $script
+
+	fn rate label cmd {
+		let (t = `{time $cmd >[2=1] > /dev/null}) {
+			echo -n $label^': '
+			awk -v 'n='^$count -v 'u='^<={~~ $t(2) *u} -v 's='^<={~~ $t(3) *s} 'BEGIN {
+				if (u + s > 0)
+					printf "%d commands/sec (%.1fs cpu)\n", n / (u + s), u + s
+				else
+					print "too fast to measure; use a larger count"
+			}'
+		}
+	}
+
+	unwind-protect {
+		rate file {$shell $script}
+		rate stdin {$shell < $script}
+	} {
+		rm -f $script
+	}
+}
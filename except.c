@@ -2,6 +2,7 @@
 
 #include "es.h"
 #include "print.h"
+#include "term.h"
 
 /* globals */
 Handler *tophandler = NULL;
@@ -9,6 +10,8 @@ Handler *roothandler = NULL;
 List *exception = NULL;
 Push *pushlist = NULL;
 
+static const Term errorterm = { "error", NULL };
+
 /* pophandler -- remove a handler */
 extern void pophandler(Handler *handler) {
 	assert(tophandler == handler);
@@ -57,7 +60,7 @@ extern Noreturn fail VARARGS2(const char *, from, const char *, fmt) {
 	va_end(args);
 
 	gcdisable();
-	Ref(List *, e, mklist(mkstr("error"),
+	Ref(List *, e, mklist((Term *) &errorterm,
 			      mklist(mkstr((char *) from),
 				     mklist(mkstr(s), NULL))));
 	while (gcisblocked())
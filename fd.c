@@ -1,12 +1,52 @@
 /* fd.c -- file descriptor manipulations ($Revision: 1.2 $) */
 
+#define	_GNU_SOURCE	1	/* for memfd_create() and pipe2() */
+#define	REQUIRE_FCNTL	1
+#define	REQUIRE_MMAN	1
+
 #include "es.h"
 
 
+/* anonfile -- open a nameless, seekable scratch file, closed on exec */
+extern int anonfile(const char *name) {
+	int fd;
+#if HAVE_MEMFD_CREATE
+	fd = memfd_create(name, MFD_CLOEXEC);
+	if (fd != -1 || errno != ENOSYS)
+		return fd;
+#endif
+	{
+		char *dir = getenv("TMPDIR"), *path;
+		if (dir == NULL || *dir == '\0')
+			dir = "/tmp";
+		path = str("%s/es-%s.XXXXXX", dir, name);
+		if ((fd = mkstemp(path)) == -1)
+			return -1;
+		unlink(path);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+	return fd;
+}
+
+/* cloexecpipe -- create a pipe whose ends are closed on exec */
+extern int cloexecpipe(int p[2]) {
+#if HAVE_PIPE2
+	return pipe2(p, O_CLOEXEC);
+#else
+	if (pipe(p) == -1)
+		return -1;
+	fcntl(p[0], F_SETFD, FD_CLOEXEC);
+	fcntl(p[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
 /* mvfd -- duplicate a fd and close the old */
 extern void mvfd(int old, int new) {
 	if (old != new) {
-		int fd = dup2(old, new);
+		int fd;
+		quietflush();
+		fd = dup2(old, new);
 		if (fd == -1)
 			fail("es:mvfd", "dup2: %s", esstrerror(errno));
 		assert(fd == new);
@@ -32,6 +72,7 @@ static int defcount = 0, defmax = 0;
 
 static void dodeferred(int realfd, int userfd) {
 	assert(userfd >= 0);
+	quietflush();
 	releasefd(userfd);
 
 	if (realfd == -1)
@@ -83,6 +124,7 @@ extern void undefer(int ticket) {
 		assert(defcount > 0);
 		defer = &deftab[--defcount];
 		assert(ticket == defcount);
+		quietflush();
 		unregisterfd(&defer->realfd);
 		if (defer->realfd != -1)
 			close(defer->realfd);
@@ -177,6 +219,65 @@ extern void closefds(void) {
 	}
 }
 
+/* isdeferfd -- is this registered descriptor the source of a deferred operation? */
+static Boolean isdeferfd(int *fdp) {
+	int i;
+	for (i = 0; i < defcount; i++)
+		if (fdp == &deftab[i].realfd)
+			return TRUE;
+	return FALSE;
+}
+
+/* openinchild -- would fd be open after the first n deferred operations? */
+static Boolean openinchild(int fd, int n) {
+	while (--n >= 0) {
+		Defer *defer = &deftab[n];
+		if (defer->userfd == fd)
+			return defer->realfd != -1;
+		if (defer->realfd == fd)
+			return FALSE;
+	}
+	return fcntl(fd, F_GETFD) != -1;
+}
+
+/*
+ * spawnfds -- describe what closefds() would do in a new child as a
+ *	sequence of dup2 and close operations, for posix_spawn().  returns
+ *	FALSE if releasefd() would have to move a descriptor out of the way
+ *	first, which cannot be expressed that way.
+ */
+extern Boolean spawnfds(void (*dupfd)(void *, int, int), void (*closefd)(void *, int), void *arg) {
+	int i, j;
+
+	for (i = 0; i < defcount; i++) {
+		int fd = deftab[i].userfd;
+		for (j = i + 1; j < defcount; j++)
+			if (deftab[j].realfd == fd)
+				return FALSE;
+		for (j = 0; j < rescount; j++)
+			if (*reserved[j].fdp == fd && !isdeferfd(reserved[j].fdp))
+				return FALSE;
+	}
+
+	for (i = 0; i < defcount; i++) {
+		Defer *defer = &deftab[i];
+		if (defer->realfd == -1) {
+			if (openinchild(defer->userfd, i))
+				(*closefd)(arg, defer->userfd);
+		} else if (defer->realfd != defer->userfd) {
+			(*dupfd)(arg, defer->realfd, defer->userfd);
+			(*closefd)(arg, defer->realfd);
+		}
+	}
+	for (i = 0; i < rescount; i++) {
+		Reserve *r = &reserved[i];
+		int fd = *r->fdp;
+		if (r->closeonfork && fd >= 3 && !isdeferfd(r->fdp) && openinchild(fd, defcount))
+			(*closefd)(arg, fd);
+	}
+	return TRUE;
+}
+
 /* releasefd -- release a specific file descriptor from its es uses */
 extern void releasefd(int n) {
 	int i;
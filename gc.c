@@ -40,12 +40,17 @@ Tag StringTag;
 
 /* own variables */
 static Space *new, *old, *pspace;
+#if !GCPROTECT
+static Space *sparepspace;		/* kept by pseal for the next parse */
+#endif
 #if GCPROTECT
 static Space *spaces;
 #endif
 static Root *globalrootlist, *exceptionrootlist;
 static size_t minspace = MIN_minspace;	/* minimum number of bytes in a new space */
 static size_t minpspace = MIN_minpspace;
+static size_t allocated = 0, lastlive = 0;	/* see gcallocated() */
+static int collections = 0;
 
 
 /*
@@ -198,6 +203,17 @@ static Space *claimspace(Space *space, Space *next, size_t size) {
 #define	newpspace(next)		allocspace(next, minpspace)
 
 extern void *createpspace(void) {
+#if !GCPROTECT
+	Space *space = sparepspace;
+	if (space != NULL) {
+		sparepspace = NULL;
+		if ((size_t) SPACESIZE(space) >= minpspace) {
+			space->current = space->bot;
+			return (void *)space;
+		}
+		efree(space);
+	}
+#endif
 	return (void *)newpspace(NULL);
 }
 
@@ -236,6 +252,23 @@ static void deprecate(Space *space) {
 	}
 }
 
+/*
+ * releasepspace -- dispose of a sealed pspace chain.  without GCPROTECT,
+ *	the most recently allocated block is kept for the next createpspace,
+ *	so a shell running a long script does not pay for malloc and free
+ *	around every command it parses.
+ */
+static void releasepspace(Space *space) {
+#if !GCPROTECT
+	if (space != NULL && sparepspace == NULL) {
+		sparepspace = space;
+		space = space->next;
+		sparepspace->next = NULL;
+	}
+#endif
+	deprecate(space);
+}
+
 /* isinspace -- does an object lie inside a given Space? */
 extern Boolean isinspace(Space *space, void *p) {
 	for (; space != NULL; space = space->next)
@@ -329,6 +362,16 @@ extern void *forward(void *p) {
 	return np;
 }
 
+/* weakforward -- during a collection, where an old-space object went, or NULL if it died */
+extern void *weakforward(void *p) {
+	Tag *tag;
+	assert(old != NULL && !pmode);
+	if (!isinspace(old, p))
+		return p;
+	tag = TAG(p);
+	return FORWARDED(tag) ? FOLLOW(tag) : NULL;
+}
+
 /* scanroots -- scan a rootlist */
 static void scanroots(Root *rootlist) {
 	Root *root;
@@ -403,18 +446,32 @@ extern Boolean gcisblocked(void) {
 	return gcblocked != 0;
 }
 
+/*
+ * gcallocated -- the number of bytes allocated in gc space so far.
+ *	what a collection finds in use, less what survived the previous
+ *	one, was allocated between the two.
+ */
+extern size_t gcallocated(void) {
+	size_t used = 0;
+	Space *space;
+	for (space = new; space != NULL; space = space->next)
+		used += SPACEUSED(space);
+	return allocated + used - lastlive;
+}
+
+/* gccollections -- the number of collections so far */
+extern int gccollections(void) {
+	return collections;
+}
+
 /* gc -- actually do a garbage collection */
 extern void gc(void) {
 	do {
-		size_t livedata;
+		size_t livedata, olddata = 0;
 		Space *space;
 
-#if GCINFO
-		size_t olddata = 0;
-		if (gcinfo)
-			for (space = new; space != NULL; space = space->next)
-				olddata += SPACEUSED(space);
-#endif
+		for (space = new; space != NULL; space = space->next)
+			olddata += SPACEUSED(space);
 
 		assert(gcblocked >= 0);
 		if (gcblocked > 0)
@@ -447,6 +504,10 @@ extern void gc(void) {
 		scanroots(exceptionrootlist);
 		VERBOSE(("GC scanning new space\n"));
 		scanspace();
+#if HASHCONS
+		VERBOSE(("GC sweeping shared trees\n"));
+		sweeptrees();
+#endif
 		VERBOSE(("GC collection done\n\n"));
 
 		deprecate(old);
@@ -454,6 +515,9 @@ extern void gc(void) {
 
 		for (livedata = 0, space = new; space != NULL; space = space->next)
 			livedata += SPACEUSED(space);
+		allocated += olddata - lastlive;
+		lastlive = livedata;
+		collections++;
 
 #if GCINFO
 		if (gcinfo)
@@ -487,7 +551,7 @@ extern void *pseal(void *p) {
 		psize += SPACEUSED(sp);
 
 	if (psize == 0) {
-		deprecate(pspace);
+		releasepspace(pspace);
 		return p;
 	}
 
@@ -537,7 +601,7 @@ extern void *pseal(void *p) {
 	for (base = pspace; base->next != NULL; base = base->next)
 		;
 #endif
-	deprecate(pspace);
+	releasepspace(pspace);
 	--gcblocked;
 	return p;
 }
@@ -731,7 +795,6 @@ extern void freebuffer(Buffer *buf) {
 static char *tree1name(NodeKind k) {
 	switch(k) {
 	default:	panic("tree1name: bad node kind %d", k);
-	case nPrim:	return "Prim";
 	case nQword:	return "Qword";
 	case nCall:	return "Call";
 	case nThunk:	return "Thunk";
@@ -753,6 +816,7 @@ static char *tree2name(NodeKind k) {
 	case nLocal:	return "Local";
 	case nMatch:	return "Match";
 	case nExtract:	return "Extract";
+	case nPrim:	return "Prim";
 	case nVarsub:	return "Varsub";
 	}
 }
@@ -55,3 +55,8 @@ extern char *psealcountedbuffer(Buffer *buf);	/* pspace variant of sealcountedbu
 extern void freebuffer(Buffer *buf);
 
 extern void *forward(void *p);
+extern void *weakforward(void *p);
+
+#if HASHCONS
+extern void sweeptrees(void);
+#endif
@@ -3,6 +3,8 @@
 #include "es.h"
 #include "gc.h"
 
+#include <limits.h>
+
 /* concat -- cartesion cross product concatenation */
 extern List *concat(List *list1, List *list2) {
 	List **p, *result = NULL;
@@ -84,17 +86,14 @@ static List *qconcat(List *list1, List *list2, StrList *ql1, StrList *ql2, StrLi
 }
 
 /* subscript -- variable subscripting */
-static List *subscript(List *list, List *subs) {
-	int lo, hi, len, counter;
+static List *subscript(char *name, Binding *binding, List *list, List *subs) {
+	int lo, hi;
 	List *result, **prevp, *current;
 
 	gcdisable();
 
 	result = NULL;
 	prevp = &result;
-	len = length(list);
-	current = list;
-	counter = 1;
 
 	if (subs != NULL && streq(getstr(subs->term), "...")) {
 		lo = 1;
@@ -114,7 +113,7 @@ static List *subscript(List *list, List *subs) {
 		mid_range:
 			subs = subs->next;
 			if (subs == NULL)
-				hi = len;
+				hi = INT_MAX;
 			else {
 				hi = atoi(getstr(subs->term));
 				if (hi < 1) {
@@ -123,21 +122,12 @@ static List *subscript(List *list, List *subs) {
 					fail("es:subscript", "bad subscript: %s", bad);
 					RefEnd(bad);
 				}
-				if (hi > len)
-					hi = len;
 				subs = subs->next;
 			}
 		} else
 			hi = lo;
-		if (lo > len)
-			continue;
-		if (counter > lo) {
-			current = list;
-			counter = 1;
-		}
-		for (; counter < lo; counter++, current = current->next)
-			;
-		for (; counter <= hi; counter++, current = current->next) {
+		current = varindex(name, binding, list, lo);
+		for (; current != NULL && lo <= hi; lo++, current = current->next) {
 			*prevp = mklist(current->term, NULL);
 			prevp = &(*prevp)->next;
 		}
@@ -205,7 +195,7 @@ static List *glom1(Tree *tree, Binding *binding) {
 			list = varlookup(name, bp);
 			Ref(List *, sub, glom1(tp->u[1].p, bp));
 			tp = NULL;
-			list = subscript(list, sub);
+			list = subscript(name, bp, list, sub);
 			RefEnd2(sub, name);
 			break;
 		case nCall:
@@ -0,0 +1,503 @@
+/* image.c -- run-time images of the shell's definitions ($Revision: 1.1 $) */
+
+#define	REQUIRE_STAT	1
+#define	REQUIRE_FCNTL	1
+#define	REQUIRE_MMAN	1
+
+#include "es.h"
+#include "gc.h"
+#include "var.h"
+#include "term.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+/*
+ * images
+ *	$&dumpimage does at run time what esdump does when es is built:
+ *	it writes the functions, settors and variables the user has
+ *	defined into a file, and es -m maps that file back in at startup.
+ *	the objects are stored as they lie in memory, with each pointer
+ *	replaced by its offset in the file, and a table of where those
+ *	pointers are lets the loader relocate them.  once relocated, the
+ *	image is read-only and lives outside the collector's spaces,
+ *	like the data compiled from initial.es.
+ *
+ *	variables defined by initial.es, those that came from the
+ *	environment, and the per-process ones listed in volatiles[] are
+ *	not dumped, since they are set up again whenever es starts.
+ *
+ *	two kinds of object may be changed in place, so they are kept in
+ *	a writable section after the read-only one:  bindings, which are
+ *	assigned to when a lexically bound variable is, and terms holding
+ *	code as a string, which getclosure() turns into closures.  the
+ *	slots they change are registered as roots of the collector.
+ *
+ *	an image depends on the layout of objects in the es that wrote it;
+ *	its header records enough of that layout to refuse a mismatch.
+ *	apart from its tables, an image is trusted like any script.
+ */
+
+#define	IMAGEMAGIC	"es-image"
+#define	IMAGEVERSION	1
+
+typedef struct {
+	char magic[8];
+	uint32_t version, kinds, ptrsize, treesize;
+	uint64_t size;			/* of the whole file */
+	uint64_t writable, data;	/* start of writable objects, end of all objects */
+	uint64_t defs, ndefs;		/* (name, definition) pairs, in order */
+	uint64_t relocs, nrelocs;	/* pointer slots */
+	uint64_t prims, nprims;		/* nPrim trees */
+	uint64_t roots, nroots;		/* slots which must be gc roots */
+} Header;
+
+static const char *const volatiles[] = { "pid", "apid", "bqstatus", NULL };
+
+#define	ALIGN(n)	(((n) + sizeof (void *) - 1) &~ (sizeof (void *) - 1))
+
+
+/*
+ * dumping
+ *	garbage collection is disabled while the image is built, so that
+ *	addresses of objects are stable.  an offset into the writable
+ *	section is tagged with WRITABLE until the image is laid out.
+ */
+
+#define	WRITABLE	((size_t) 1 << (sizeof (size_t) * CHAR_BIT - 1))
+
+typedef struct {
+	size_t *v;
+	size_t count, size;
+} Offsets;
+
+static Buffer *ro, *rw;
+static Offsets relocs, prims, roots, defs;
+static Dict *objects, *strings;
+
+static void addoffset(Offsets *o, size_t n) {
+	if (o->count == o->size) {
+		o->size = (o->size == 0) ? 64 : o->size * 2;
+		o->v = erealloc(o->v, o->size * sizeof (size_t));
+	}
+	o->v[o->count++] = n;
+}
+
+static void freeoffsets(Offsets *o) {
+	if (o->v != NULL)
+		efree(o->v);
+	memzero(o, sizeof (Offsets));
+}
+
+/* at -- the address of an offset; only valid until the next allocation */
+static char *at(size_t off) {
+	return (off & WRITABLE) ? &rw->str[off &~ WRITABLE] : &ro->str[off];
+}
+
+/* allocate -- reserve zeroed space for an object */
+static size_t allocate(Boolean writable, size_t n) {
+	Buffer **bufp = writable ? &rw : &ro;
+	size_t off;
+	static const char zeroes[64];
+	while ((*bufp)->current != ALIGN((*bufp)->current))
+		*bufp = bufputc(*bufp, '\0');
+	off = (*bufp)->current;
+	for (; n > sizeof zeroes; n -= sizeof zeroes)
+		*bufp = bufncat(*bufp, zeroes, sizeof zeroes);
+	*bufp = bufncat(*bufp, zeroes, n);
+	return writable ? off | WRITABLE : off;
+}
+
+/* setptr -- point a slot at an object */
+static void setptr(size_t slot, size_t target) {
+	if (target != 0) {
+		memcpy(at(slot), &target, sizeof target);
+		addoffset(&relocs, slot);
+	}
+}
+
+static size_t seen(void *p) {
+	return (size_t) dictget(objects, str("%ulx", p));
+}
+
+static void remember(void *p, size_t off) {
+	objects = dictput(objects, str("%ulx", p), (void *) off);
+}
+
+static size_t dumplist(List *list);
+
+static size_t dumpstring(char *s) {
+	size_t off;
+	if (s == NULL)
+		return 0;
+	if ((off = (size_t) dictget(strings, s)) == 0) {
+		size_t len = strlen(s) + 1;
+		off = allocate(FALSE, len);
+		memcpy(at(off), s, len);
+		strings = dictput(strings, s, (void *) off);
+	}
+	return off;
+}
+
+static size_t dumptree(Tree *tree) {
+	size_t off;
+	if (tree == NULL)
+		return 0;
+	if ((off = seen(tree)) != 0)
+		return off;
+	off = allocate(FALSE, sizeof (Tree));
+	remember(tree, off);
+	memcpy(at(off), &tree->kind, sizeof (NodeKind));
+	switch (tree->kind) {
+	    case nPrim:
+		addoffset(&prims, off);
+		FALLTHROUGH;
+	    case nWord: case nQword:
+		setptr(off + offsetof(Tree, u[0].s), dumpstring(tree->u[0].s));
+		break;
+	    case nCall: case nThunk: case nVar:
+		setptr(off + offsetof(Tree, u[0].p), dumptree(tree->u[0].p));
+		break;
+	    case nAssign:  case nConcat: case nClosure: case nFor:
+	    case nLambda: case nLet: case nList:  case nLocal:
+	    case nVarsub: case nMatch: case nExtract:
+		setptr(off + offsetof(Tree, u[0].p), dumptree(tree->u[0].p));
+		setptr(off + offsetof(Tree, u[1].p), dumptree(tree->u[1].p));
+		break;
+	    default:
+		panic("dumptree: bad node kind %d", tree->kind);
+	}
+	return off;
+}
+
+static size_t dumpbinding(Binding *binding) {
+	size_t first = 0, prev = 0;
+	for (; binding != NULL; binding = binding->next) {
+		size_t off = seen(binding);
+		if (off != 0) {
+			if (prev == 0)
+				return off;
+			setptr(prev + offsetof(Binding, next), off);
+			break;
+		}
+		off = allocate(TRUE, sizeof (Binding));
+		remember(binding, off);
+		addoffset(&roots, off + offsetof(Binding, defn));
+		setptr(off + offsetof(Binding, name), dumpstring(binding->name));
+		setptr(off + offsetof(Binding, defn), dumplist(binding->defn));
+		if (prev == 0)
+			first = off;
+		else
+			setptr(prev + offsetof(Binding, next), off);
+		prev = off;
+	}
+	return first;
+}
+
+static size_t dumpclosure(Closure *closure) {
+	size_t off;
+	if (closure == NULL)
+		return 0;
+	if ((off = seen(closure)) != 0)
+		return off;
+	off = allocate(FALSE, sizeof (Closure));
+	remember(closure, off);
+	setptr(off + offsetof(Closure, binding), dumpbinding(closure->binding));
+	setptr(off + offsetof(Closure, tree), dumptree(closure->tree));
+	return off;
+}
+
+static size_t dumpterm(Term *term) {
+	size_t off;
+	Boolean code;
+	if ((off = seen(term)) != 0)
+		return off;
+	code = term->str != NULL && iscodestring(term->str);
+	off = allocate(code, sizeof (Term));
+	remember(term, off);
+	if (code)
+		addoffset(&roots, off + offsetof(Term, closure));
+	setptr(off + offsetof(Term, str), dumpstring(term->str));
+	setptr(off + offsetof(Term, closure), dumpclosure(term->closure));
+	return off;
+}
+
+static size_t dumplist(List *list) {
+	size_t first = 0, prev = 0;
+	for (; list != NULL; list = list->next) {
+		size_t off = seen(list);
+		if (off != 0) {
+			if (prev == 0)
+				return off;
+			setptr(prev + offsetof(List, next), off);
+			break;
+		}
+		off = allocate(FALSE, sizeof (List));
+		remember(list, off);
+		setptr(off + offsetof(List, term), dumpterm(list->term));
+		if (prev == 0)
+			first = off;
+		else
+			setptr(prev + offsetof(List, next), off);
+		prev = off;
+	}
+	return first;
+}
+
+/* isvolatile -- is a variable set up again whenever es starts? */
+static Boolean isvolatile(const char *name, Var *var) {
+	int i;
+	if (var->flags & (var_isinternal|var_isimported))
+		return TRUE;
+	if ((*name == '*' || *name == '0') && name[1] == '\0')
+		return TRUE;
+	for (i = 0; volatiles[i] != NULL; i++)
+		if (streq(name, volatiles[i]))
+			return TRUE;
+	return FALSE;
+}
+
+static void dumpdef(char *name, Var *var) {
+	if (isvolatile(name, var))
+		return;
+	addoffset(&defs, dumpstring(name));
+	addoffset(&defs, dumplist(var->defn));
+}
+
+static void dumpfunctions(void UNUSED *ignore, char *key, void *value) {
+	if (hasprefix(key, "fn-"))
+		dumpdef(key, value);
+}
+
+static void dumpsettors(void UNUSED *ignore, char *key, void *value) {
+	if (hasprefix(key, "set-"))
+		dumpdef(key, value);
+}
+
+static void dumpvariables(void UNUSED *ignore, char *key, void *value) {
+	if (!hasprefix(key, "fn-") && !hasprefix(key, "set-"))
+		dumpdef(key, value);
+}
+
+/* layout -- the final offset for a tagged one */
+static size_t layout(size_t off, size_t writable) {
+	return (off & WRITABLE) ? writable + (off &~ WRITABLE) : off;
+}
+
+static Buffer *puttable(Buffer *buf, Offsets *o, size_t writable) {
+	size_t i;
+	for (i = 0; i < o->count; i++) {
+		uint64_t n = layout(o->v[i], writable);
+		buf = bufncat(buf, (char *) &n, sizeof n);
+	}
+	return buf;
+}
+
+/* buildimage -- lay out the dumped objects as a file */
+static Buffer *buildimage(void) {
+	size_t i, table, writable;
+	Header h;
+	Buffer *image;
+
+	table = allocate(FALSE, defs.count * sizeof (void *));
+	for (i = 0; i < defs.count; i++)
+		setptr(table + i * sizeof (void *), defs.v[i]);
+	allocate(FALSE, 0);
+	writable = ro->current;
+	allocate(TRUE, 0);
+
+	for (i = 0; i < relocs.count; i++) {
+		size_t target;
+		char *slot = at(relocs.v[i]);
+		memcpy(&target, slot, sizeof target);
+		target = layout(target, writable);
+		memcpy(slot, &target, sizeof target);
+	}
+
+	memzero(&h, sizeof h);
+	memcpy(h.magic, IMAGEMAGIC, sizeof h.magic);
+	h.version = IMAGEVERSION;
+	h.kinds = nPipe;
+	h.ptrsize = sizeof (void *);
+	h.treesize = sizeof (Tree);
+	h.writable = writable;
+	h.data = writable + rw->current;
+	h.defs = table;
+	h.ndefs = defs.count / 2;
+	h.relocs = h.data;
+	h.nrelocs = relocs.count;
+	h.prims = h.relocs + h.nrelocs * sizeof (uint64_t);
+	h.nprims = prims.count;
+	h.roots = h.prims + h.nprims * sizeof (uint64_t);
+	h.nroots = roots.count;
+	h.size = h.roots + h.nroots * sizeof (uint64_t);
+	memcpy(ro->str, &h, sizeof h);
+
+	image = bufncat(openbuffer(h.size), ro->str, ro->current);
+	image = bufncat(image, rw->str, rw->current);
+	image = puttable(image, &relocs, writable);
+	image = puttable(image, &prims, writable);
+	image = puttable(image, &roots, writable);
+	assert(image->current == h.size);
+	return image;
+}
+
+/* dumpimage -- write the user's definitions to a file */
+extern void dumpimage(const char *file0) {
+	int fd;
+	Boolean ok;
+	Buffer *image;
+	char *tmp;
+
+	Ref(const char *, file, file0);
+	gcdisable();
+	objects = mkdict();
+	strings = mkdict();
+	ro = openbuffer(0);
+	rw = openbuffer(0);
+	allocate(FALSE, sizeof (Header));
+
+	/* these must be assigned in this order, as in dump.c */
+	dictforall(vars, dumpfunctions, NULL);
+	dictforall(vars, dumpsettors, NULL);
+	dictforall(vars, dumpvariables, NULL);
+	image = buildimage();
+
+	freebuffer(ro);
+	freebuffer(rw);
+	freeoffsets(&relocs);
+	freeoffsets(&prims);
+	freeoffsets(&roots);
+	freeoffsets(&defs);
+	objects = strings = NULL;
+	gcenable();
+
+	tmp = str("%s.%d", file, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		freebuffer(image);
+		fail("$&dumpimage", "%s: %s", tmp, esstrerror(errno));
+	}
+	ok = write(fd, image->str, image->current) == (long) image->current;
+	freebuffer(image);
+	if (close(fd) == -1 || !ok || rename(tmp, file) == -1) {
+		int err = errno;
+		unlink(tmp);
+		fail("$&dumpimage", "%s: %s", file, esstrerror(err));
+	}
+	RefEnd(file);
+}
+
+
+/*
+ * loading
+ */
+
+/* checktable -- is a table of offsets inside the image and aligned? */
+static Boolean checktable(Header *h, uint64_t start, uint64_t count, uint64_t lo, uint64_t hi, size_t objsize) {
+	uint64_t *v;
+	uint64_t i;
+	if (start < h->data || start % sizeof (uint64_t) != 0 || count > (h->size - start) / sizeof (uint64_t))
+		return FALSE;
+	v = (uint64_t *) ((char *) h + start);
+	for (i = 0; i < count; i++)
+		if (v[i] < lo || v[i] % sizeof (void *) != 0 || v[i] > hi || hi - v[i] < objsize)
+			return FALSE;
+	return TRUE;
+}
+
+/* checkheader -- does an image fit this es and is it well formed? */
+static Boolean checkheader(Header *h, uint64_t size) {
+	return memcmp(h->magic, IMAGEMAGIC, sizeof h->magic) == 0
+	    && h->version == IMAGEVERSION
+	    && h->kinds == nPipe
+	    && h->ptrsize == sizeof (void *)
+	    && h->treesize == sizeof (Tree)
+	    && h->size == size
+	    && sizeof (Header) <= h->writable && h->writable <= h->data && h->data <= size
+	    && sizeof (Header) <= h->defs && h->defs <= h->writable && h->defs % sizeof (void *) == 0
+	    && h->ndefs <= (h->writable - h->defs) / (2 * sizeof (void *))
+	    && h->relocs + h->nrelocs * sizeof (uint64_t) == h->prims
+	    && h->prims + h->nprims * sizeof (uint64_t) == h->roots
+	    && h->roots + h->nroots * sizeof (uint64_t) == size
+	    && checktable(h, h->relocs, h->nrelocs, sizeof (Header), h->data, sizeof (void *))
+	    && checktable(h, h->prims, h->nprims, sizeof (Header), h->writable, sizeof (Tree))
+	    && checktable(h, h->roots, h->nroots, h->writable, h->data, sizeof (void *));
+}
+
+/* relocate -- turn an image's offsets into pointers; FALSE if one is out of range */
+static Boolean relocate(char *base, Header *h) {
+	uint64_t i, *v;
+	v = (uint64_t *) (base + h->relocs);
+	for (i = 0; i < h->nrelocs; i++) {
+		char **slot = (char **) (base + v[i]);
+		size_t off = (size_t) *slot;
+		if (off < sizeof (Header) || off >= h->data)
+			return FALSE;
+		*slot = base + off;
+	}
+	v = (uint64_t *) (base + h->prims);
+	for (i = 0; i < h->nprims; i++) {
+		Tree *t = (Tree *) (base + v[i]);
+		if (t->kind != nPrim || t->u[0].s == NULL)
+			return FALSE;
+		t->u[1].prim = lookupprim(t->u[0].s);
+	}
+	return TRUE;
+}
+
+/* loadimage -- map an image and define what it holds */
+extern void loadimage(const char *file) {
+	int fd;
+	char *base;
+	struct stat st;
+	uint64_t i, *v;
+	Header *h;
+	void **defv;
+
+	if ((fd = eopen((char *) file, oOpen)) == -1)
+		fail("es:loadimage", "%s: %s", file, esstrerror(errno));
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof (Header)) {
+		close(fd);
+		fail("es:loadimage", "%s: not an es image", file);
+	}
+#if HAVE_MMAP
+	base = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		fail("es:loadimage", "%s: %s", file, esstrerror(errno));
+#else
+	base = ealloc(st.st_size);
+	i = read(fd, base, st.st_size);
+	close(fd);
+	if (i != (uint64_t) st.st_size) {
+		efree(base);
+		fail("es:loadimage", "%s: short read", file);
+	}
+#endif
+	h = (Header *) base;
+	if (!checkheader(h, st.st_size) || !relocate(base, h)) {
+#if HAVE_MMAP
+		munmap(base, st.st_size);
+#else
+		efree(base);
+#endif
+		fail("es:loadimage", "%s: not an es image for this shell", file);
+	}
+
+	v = (uint64_t *) (base + h->roots);
+	for (i = 0; i < h->nroots; i++)
+		globalroot(base + v[i]);
+#if HAVE_MMAP && HAVE_MPROTECT
+	{
+		size_t pagesize = sysconf(_SC_PAGESIZE);
+		size_t readonly = h->writable - h->writable % pagesize;
+		if (readonly > 0)
+			mprotect(base, readonly, PROT_READ);
+	}
+#endif
+
+	defv = (void **) (base + h->defs);
+	for (i = 0; i < h->ndefs; i++)
+		vardef(defv[2 * i], NULL, defv[2 * i + 1]);
+}
@@ -114,6 +114,9 @@ fn %read {
 	}
 }
 
+fn-%readlines	= $&readlines
+fn-%readfile	= $&readfile
+
 #	unwind-protect is a simple wrapper around catch that is used
 #	to ensure that some cleanup code is run after running a code
 #	fragment.  This function must be written with care to make
@@ -149,13 +152,22 @@ fn-unwind-protect = $&noreturn @ body cleanup {
 
 if {~ <=$&primitives limit} {fn-limit = $&limit}
 if {~ <=$&primitives time}  {fn-time  = $&time}
+if {~ <=$&primitives usage} {fn-%usage = $&usage}
 
 #	These builtins are mainly useful for internal functions, but
 #	they're there to be called if you want to use them.
 
 fn-%apids	= $&apids
+fn-%coclose	= $&coclose
+fn-%coproc	= $&coproc
+fn-%coread	= $&coread
+fn-%cosend	= $&cosend
+fn-%dumpimage	= $&dumpimage
+fn-%flush	= $&flush
 fn-%fsplit      = $&fsplit
 fn-%newfd	= $&newfd
+fn-%parallel	= $&parallel
+fn-%pmap	= $&pmap
 fn-%run         = $&run
 fn-%split       = $&split
 fn-%var		= $&var
@@ -4,12 +4,14 @@
 
 #include "es.h"
 #include "input.h"
+#include "term.h"
 
 /*
  * constants
  */
 
 #define	BUFSIZE		((size_t) 4096)		/* buffer size to fill reads into */
+#define	READAHEAD	((size_t) 65536)	/* block size for reading scripts */
 
 
 /*
@@ -17,6 +19,9 @@
  */
 
 static Input *input = NULL;
+static int inputdepth = 0;	/* how many inputs are being read */
+
+static const Term eofterm = { "eof", NULL };
 
 
 /*
@@ -41,6 +46,81 @@ extern void yyerror(Parser *p, const char *s) {
  * getting and ungetting characters
  */
 
+/*
+ * fillblock -- fill input buffer from the read-ahead buffer.  rather
+ *	than being copied, the block is lent to the parser, which gives
+ *	back what it did not use when it finishes (see giveback).
+ */
+static int fillblock(Parser *p) {
+	Input *in = p->input;
+	static unsigned char newline[] = "\n";
+
+	if (in->rpos == in->rend) {
+		long nread;
+		unsigned char *s, *t, *end;
+
+		/* shared input is put back after every command, so read less */
+		size_t size = in->shared ? BUFSIZE : READAHEAD;
+		if (in->rbuf == NULL)
+			in->rbuf = ealloc(size);
+		flushout();	/* the read may block, so let others see our output */
+		do {
+			nread = read(in->fd, in->rbuf, size);
+			SIGCHK();
+		} while (nread == -1 && errno == EINTR);
+		if (nread == -1)
+			fail("$&parse", "%s: %s", in->name, esstrerror(errno));
+		if (nread == 0) {
+			if (in->lastc != '\n') {	/* supply a missing final newline */
+				in->lastc = '\n';
+				p->buf = newline;
+				p->bufend = newline + 1;
+				return *p->buf++;
+			}
+			in->eof = TRUE;
+			return EOF;
+		}
+		end = in->rbuf + nread;
+		if ((s = memchr(in->rbuf, '\0', nread)) != NULL) {
+			eprint("%s\n", locate(in, "null character ignored"));
+			for (t = s; s < end; s++)
+				if (*s != '\0')
+					*t++ = *s;
+			end = t;
+		}
+		in->rpos = in->rbuf;
+		in->rend = end;
+		if (in->rpos == in->rend)
+			return fillblock(p);
+	}
+
+	p->buf = in->rpos;
+	p->bufend = in->rend;
+	in->rpos = in->rend;
+	in->lastc = in->rend[-1];
+	return *p->buf++;
+}
+
+/* giveback -- return the unparsed part of a block to the read-ahead buffer */
+static void giveback(Parser *p) {
+	Input *in = p->input;
+	if (in->rbuf != NULL && p->bufend == in->rend) {
+		in->rpos = p->buf;
+		p->buf = p->bufend;
+	}
+}
+
+/*
+ * syncinput -- discard read-ahead, moving the fd offset back to match.
+ *	done whenever anything other than the parser might read the fd.
+ */
+static void syncinput(Input *in) {
+	if (in->rpos < in->rend) {
+		lseek(in->fd, -(off_t) (in->rend - in->rpos), SEEK_CUR);
+		in->rpos = in->rend;
+	}
+}
+
 /* fill -- fill input buffer by running a command */
 static int fill(Parser *p) {
 	List *result;
@@ -50,6 +130,9 @@ static int fill(Parser *p) {
 
 	assert(p->buf == p->bufend);
 
+	if (p->reader == NULL && in->readahead)
+		return fillblock(p);
+
 	if (p->reader != NULL) {
 		result = eval(p->reader, NULL, 0);
 		read = str("%L\n", result, " ");
@@ -85,6 +168,7 @@ extern int get(Parser *p) {
 	c = p->buf < p->bufend ? *p->buf++ : fill(p);
 	if (c != EOF && p->input->runflags & run_echoinput) {
 		char buf = (char)c;
+		quietflush();
 		ewrite(2, &buf, 1);
 	}
 	return c;
@@ -117,11 +201,26 @@ extern Tree *parse(List *reader) {
 	void *oldpspace;
 	List *volatile readexception = NULL;
 
+	if (startuptimes != NULL && inputdepth == 1)	/* not for . or eval */
+		nextcommand();
 	if (input->eof) {
 		input->eof = FALSE;
-		throw(mklist(mkstr("eof"), NULL));
+		savecache(input);
+		throw(mklist((Term *) &eofterm, NULL));
 	}
 
+	if (input->cache != NULL && reader == NULL) {
+		Tree *tree;
+		if (!cachenext(input, &tree))
+			throw(mklist((Term *) &eofterm, NULL));
+#if HASHCONS
+		tree = sharetree(tree);
+#endif
+		return tree;
+	}
+	if (reader != NULL)
+		closecache(input);
+
 	memzero(&p, sizeof (Parser));
 	p.input = input;
 	p.reader = reader;
@@ -129,14 +228,19 @@ extern Tree *parse(List *reader) {
 	p.space = createpspace();
 	oldpspace = setpspace(p.space);
 
+	if (reader != NULL)
+		syncinput(input);
+
 	inityy(&p);
 	initbuf(&p);
 	p.tokenbuf = ealloc(p.bufsize);
 
-	fd = (input->fd == -1)
-		? eopen("/dev/null", oOpen)
-		: dup(input->fd);
-	ticket = defer_mvfd(TRUE, fd, 0);
+	if (reader != NULL || !input->readahead) {
+		fd = (input->fd == -1)
+			? eopen("/dev/null", oOpen)
+			: dup(input->fd);
+		ticket = defer_mvfd(TRUE, fd, 0);
+	}
 
 	ExceptionHandler
 
@@ -148,6 +252,9 @@ extern Tree *parse(List *reader) {
 
 	EndExceptionHandler
 
+	giveback(&p);
+	if (input->shared)
+		syncinput(input);
 	undefer(ticket);
 	RefRemove(p.reader);
 	assert(p.ungot == 0);
@@ -160,6 +267,7 @@ extern Tree *parse(List *reader) {
 		assert(p.error != NULL || readexception != NULL);
 		Ref(const char *, e, p.error != NULL ? str("%s", p.error) : NULL);
 		pseal(NULL);
+		closecache(input);
 		setpspace(oldpspace);
 		if (e != NULL)
 			fail("$&parse", "%s", e);
@@ -170,6 +278,11 @@ extern Tree *parse(List *reader) {
 
 	Ref(Tree *, tree, pseal(p.tree));
 	setpspace(oldpspace);
+	if (input->record != NULL)
+		cacherecord(input, tree);
+#if HASHCONS
+	tree = sharetree(tree);
+#endif
 #if LISPTREES
 	if (input->runflags & run_lisptrees)
 		eprint("%B\n", tree);
@@ -185,9 +298,14 @@ extern Tree *parse(List *reader) {
 /* cleanup -- clean up after an input source */
 static void cleanup(Input *in) {
 	if (in->fd != -1) {
+		if (in->shared)
+			syncinput(in);
 		unregisterfd(&in->fd);
 		close(in->fd);
 	}
+	if (in->rbuf != NULL)
+		efree(in->rbuf);
+	closecache(in);
 }
 
 /* runinput -- run from an input source */
@@ -207,6 +325,8 @@ extern List *runinput(Input *in, int runflags) {
 	flags &= ~eval_inchild;
 	in->runflags = flags;
 	input = in;
+	inputdepth++;
+	opencache(in);
 
 	ExceptionHandler
 
@@ -234,12 +354,14 @@ extern List *runinput(Input *in, int runflags) {
 
 		cleanup(input);
 		input = prev;
+		inputdepth--;
 		throw(e);
 
 	EndExceptionHandler
 
 	cleanup(input);
 	input = prev;
+	inputdepth--;
 	return result;
 }
 
@@ -252,6 +374,7 @@ extern List *runinput(Input *in, int runflags) {
 extern List *runfd(int fd, const char *name, int flags) {
 	Input in;
 	List *result;
+	struct stat st;
 
 	memzero(&in, sizeof (Input));
 	in.lineno = 1;
@@ -259,6 +382,22 @@ extern List *runfd(int fd, const char *name, int flags) {
 	registerfd(&in.fd, TRUE);
 	in.name = (name == NULL) ? str("fd %d", fd) : name;
 
+	/*
+	 * a regular file that es opened itself is private, and is read a
+	 * block at a time.  anything else, such as the standard descriptors
+	 * or a pipe reopened through /dev/stdin, may be shared with the
+	 * commands run, so it is read ahead only if the offset can be put
+	 * back after each command is parsed; otherwise $&read takes one
+	 * line at a time.
+	 */
+	in.lastc = '\n';
+	in.shared = (fd < 3 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode));
+#if HAVE_LSEEK
+	in.readahead = !in.shared || lseek(fd, 0, SEEK_CUR) != -1;
+#else
+	in.readahead = !in.shared;
+#endif
+
 	RefAdd(in.name);
 	result = runinput(&in, flags);
 	RefRemove(in.name);
@@ -294,6 +433,7 @@ extern Tree *parseinput(Input *in) {
 
 	in->runflags = 0;
 	input = in;
+	inputdepth++;
 
 	ExceptionHandler
 		result = parse(NULL);
@@ -302,11 +442,13 @@ extern Tree *parseinput(Input *in) {
 	CatchException (e)
 		cleanup(input);
 		input = prev;
+		inputdepth--;
 		throw(e);
 	EndExceptionHandler
 
 	cleanup(input);
 	input = prev;
+	inputdepth--;
 	return result;
 }
 
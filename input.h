@@ -11,6 +11,18 @@ struct Input {
 	int fd;
 	Boolean eof;
 	int runflags;
+
+	/* read-ahead buffer, for non-interactive input from fd */
+	Boolean readahead;	/* input may be read a block at a time */
+	Boolean shared;		/* other processes may read the fd */
+	int lastc;		/* last character handed to the parser */
+	unsigned char *rbuf, *rpos, *rend;
+
+	/* parse cache, being replayed or recorded (see cache.c) */
+	unsigned char *cache, *cachepos;
+	size_t cachelen;
+	char *cachename;
+	struct Buffer *record;
 };
 
 typedef enum { NW, RW, KW } WordState;	/* nonword, realword, keyword */
@@ -48,6 +60,15 @@ extern void unget(Parser *p, int c);
 extern void yyerror(Parser *p, const char *s);
 
 
+/* cache.c */
+
+extern void opencache(Input *in);
+extern Boolean cachenext(Input *in, Tree **treep);
+extern void cacherecord(Input *in, Tree *tree);
+extern void savecache(Input *in);
+extern void closecache(Input *in);
+
+
 /* token.c */
 
 extern const char dnw[];
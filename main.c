@@ -1,7 +1,13 @@
 /* main.c -- initialization for es ($Revision: 1.3 $) */
 
+#define	REQUIRE_FCNTL	1
+
 #include "es.h"
 
+#if HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+
 #if GCVERBOSE
 Boolean gcverbose	= FALSE;	/* -G */
 #endif
@@ -17,6 +23,113 @@ Boolean gcinfo		= FALSE;	/* -I */
 extern char **environ;
 
 
+/*
+ * startup timing
+ *	if $ES_STARTUP_TIMES is in the environment when es starts, the
+ *	elapsed time, gc allocation and collections of each phase of
+ *	startup are reported once the first command has been run, that
+ *	is, when the shell asks for the next command or exits.  there is
+ *	one line per phase, with tab-separated fields:
+ *		pid  phase  microseconds  bytes  collections
+ *	followed by a line for the total.  the report is appended to the
+ *	file the variable names, or written to standard error if it is
+ *	empty or -.
+ */
+
+#define	MAXPHASES	16
+
+typedef struct {
+	const char *name;
+	long usec;
+	size_t bytes;
+	int collections;
+} Phase;
+
+const char *startuptimes = NULL;
+static Phase phases[MAXPHASES];
+static int nphases = 0, current = -1, startpid;
+static long phasestart;
+static size_t phasebytes;
+static int phasecollections;
+
+static long now(void) {
+#if HAVE_GETTIMEOFDAY
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+#else
+	return time(NULL) * 1000000L;
+#endif
+}
+
+/* startphase -- charge what has happened so far to the current phase, and start another */
+extern const char *startphase(const char *name) {
+	int i;
+	long t = now();
+	size_t bytes = gcallocated();
+	int collections = gccollections();
+	const char *prev = NULL;
+
+	if (current != -1) {
+		Phase *p = &phases[current];
+		p->usec += t - phasestart;
+		p->bytes += bytes - phasebytes;
+		p->collections += collections - phasecollections;
+		prev = p->name;
+	}
+	for (i = 0; i < nphases; i++)
+		if (streq(phases[i].name, name))
+			break;
+	if (i == nphases) {
+		if (nphases == MAXPHASES)
+			panic("startphase: too many phases");
+		phases[nphases++].name = name;
+	}
+	current = i;
+	phasestart = t;
+	phasebytes = bytes;
+	phasecollections = collections;
+	return prev;
+}
+
+/* nextcommand -- the parser wants a command; the second time, the first command has run */
+extern void nextcommand(void) {
+	static int n = 0;
+	if (streq(phases[current].name, "firstcmd") && ++n == 2)
+		reportphases();
+}
+
+/* reportphases -- write out the phase timings, once, from the original shell */
+extern void reportphases(void) {
+	int i, fd;
+	Phase total;
+	const char *file = startuptimes;
+
+	startuptimes = NULL;
+	if (getpid() != startpid)
+		return;
+	startphase("end");		/* closes the last real phase */
+	if (*file == '\0' || streq(file, "-"))
+		fd = 2;
+	else if ((fd = open(file, O_WRONLY | O_APPEND | O_CREAT, 0666)) == -1) {
+		eprint("%s: %s\n", file, esstrerror(errno));
+		return;
+	}
+	memzero(&total, sizeof total);
+	for (i = 0; i < nphases - 1; i++) {
+		Phase *p = &phases[i];
+		fprint(fd, "%d\t%s\t%ld\t%uld\t%d\n",
+		       startpid, p->name, p->usec, (unsigned long) p->bytes, p->collections);
+		total.usec += p->usec;
+		total.bytes += p->bytes;
+		total.collections += p->collections;
+	}
+	fprint(fd, "%d\ttotal\t%ld\t%uld\t%d\n",
+	       startpid, total.usec, (unsigned long) total.bytes, total.collections);
+	if (fd != 2)
+		close(fd);
+}
+
 /* checkfd -- open /dev/null on an fd if it is closed */
 static void checkfd(int fd, OpenKind r) {
 	int new;
@@ -69,10 +182,28 @@ static void runesrc(void) {
 	}
 }
 
+/* runimage -- load a dumped image, returning FALSE if it could not be */
+static Boolean runimage(const char *image) {
+	ExceptionHandler
+		loadimage(image);
+	CatchException (e)
+		if (termeq(e->term, "exit"))
+			exit(exitstatus(e->next));
+		else if (termeq(e->term, "error"))
+			eprint("%L\n",
+			       e->next == NULL ? NULL : e->next->next,
+			       " ");
+		else if (!issilentsignal(e))
+			eprint("uncaught exception: %L\n", e, " ");
+		return FALSE;
+	EndExceptionHandler
+	return TRUE;
+}
+
 /* usage -- print usage message and die */
 static Noreturn usage(void) {
 	eprint(
-		"usage: es [-c command] [-silevxnpo] [file [args ...]]\n"
+		"usage: es [-c command] [-silevxnpo] [-m image] [-S socket] [-C socket] [file [args ...]]\n"
 		"	-c cmd	execute argument\n"
 		"	-s	read commands from standard input; stop option parsing\n"
 		"	-i	interactive shell\n"
@@ -84,6 +215,9 @@ static Noreturn usage(void) {
 		"	-p	don't load functions from the environment\n"
 		"	-o	don't open stdin, stdout, and stderr if they were closed\n"
 		"	-d	don't ignore SIGQUIT or SIGTERM\n"
+		"	-m img	load definitions from a %%dumpimage file, not .esrc\n"
+		"	-S sock	initialize, then serve requests on a socket\n"
+		"	-C sock	pass this invocation to the server on sock, if any\n"
 	);
 	eprint(""
 #if GCINFO
@@ -100,8 +234,11 @@ static Noreturn usage(void) {
 }
 
 
-/* main -- initialize, parse command arguments, and start running */
-int main(int argc, char **argv0) {
+/*
+ * esmain -- parse command arguments and start running.  warm is set in
+ *	a child of a server, where the shell has already been initialized.
+ */
+static int esmain(int argc, char **argv0, Boolean warm) {
 	int c, status = 0;
 	char **volatile argv = argv0;
 
@@ -111,23 +248,17 @@ int main(int argc, char **argv0) {
 	volatile Boolean cmd_stdin = FALSE;		/* -s */
 	volatile Boolean loginshell = FALSE;	/* -l or $0[0] == '-' */
 	Boolean keepclosed = FALSE;		/* -o */
+	const char *volatile listenpath = NULL;	/* -S */
+	const char *serverpath = NULL;		/* -C */
 	Ref(const char *volatile, cmd, NULL);	/* -c */
+	Ref(const char *volatile, image, NULL);	/* -m */
 
-	initconv();
-	initgc();
-
-	if (argc == 0) {
-		argc = 1;
-		argv = ealloc(2 * sizeof (char *));
-		argv[0] = "es";
-		argv[1] = NULL;
-	}
 	if (*argv[0] == '-')
 		loginshell = TRUE;
 
 	Ref(List *, args, listify(argc, argv));
 	esoptbegin(args->next, NULL, NULL, FALSE);
-	while ((c = esopt("eilxvnpodsc:?GIL")) != EOF)
+	while ((c = esopt("eilxvnpodsc:m:S:C:?GIL")) != EOF)
 		switch (c) {
 		case 'c':	cmd = getstr(esoptarg());	break;
 		case 'e':	runflags |= eval_exitonfalse;	break;
@@ -143,6 +274,9 @@ int main(int argc, char **argv0) {
 		case 'o':	keepclosed = TRUE;		break;
 		case 'd':	allowquit = TRUE;		break;
 		case 's':	cmd_stdin = TRUE;		goto getopt_done;
+		case 'm':	image = getstr(esoptarg());	break;
+		case 'S':	listenpath = getstr(esoptarg());	break;
+		case 'C':	serverpath = getstr(esoptarg());	break;
 #if GCVERBOSE
 		case 'G':	gcverbose = TRUE;		break;
 #endif
@@ -160,6 +294,14 @@ getopt_done:
 		eprint("es: -s and -c are incompatible\n");
 		exit(1);
 	}
+	if (listenpath != NULL && warm) {
+		eprint("es: -S is not allowed in a request to a server\n");
+		exit(1);
+	}
+
+	/* a client hands over its original arguments; the server ignores -C */
+	if (serverpath != NULL && !warm)
+		client(serverpath, argc, argv);	/* returns if there is no server */
 
 	if (!keepclosed) {
 		checkfd(0, oOpen);
@@ -177,20 +319,43 @@ getopt_done:
 
 	ExceptionHandler
 		roothandler = &_localhandler;	/* unhygeinic */
-		initprims();
-		initvars();
+		if (!warm) {
+			PHASE("initprims");
+			initprims();
+			PHASE("initvars");
+			initvars();
 
-		runinitial();
+			PHASE("runinitial");
+			runinitial();
 
-		initpath();
+			PHASE("initpath");
+			initpath();
+		}
+		if (listenpath != NULL) {
+			int nargc;
+			char **nargv = serve(listenpath, &nargc);
+			status = esmain(nargc, nargv, TRUE);
+			goto return_main;
+		}
+		PHASE("initsignals");
 		initpid();
 		initsignals(runflags & run_interactive, allowquit);
 		initpgrp();
 		hidevariables();
+		if (image != NULL) {
+			PHASE("loadimage");
+			if (!runimage(image))
+				image = NULL;
+		}
+		PHASE("initenv");
 		initenv(environ, protected);
 
-		if (loginshell)
+		if (loginshell && image == NULL) {
+			PHASE("runesrc");
 			runesrc();
+		}
+
+		PHASE("firstcmd");
 
 		if (cmd == NULL && !cmd_stdin && argp != NULL) {
 			int fd;
@@ -236,10 +401,35 @@ getopt_done:
 		status = 1;
 
 	EndExceptionHandler
-	RefEnd3(argp, args, cmd);
+	RefEnd4(argp, args, image, cmd);
 return_main:
 #if JOB_PROTECT
 	tcreturnpgrp();
 #endif
 	return status;
 }
+
+/* main -- initialize and start running */
+int main(int argc, char **argv) {
+	int status;
+
+	if ((startuptimes = getenv("ES_STARTUP_TIMES")) != NULL) {
+		startpid = getpid();
+		startphase("initconv");
+	}
+	initconv();
+	PHASE("initgc");
+	initgc();
+	PHASE("options");
+
+	if (argc == 0) {
+		argc = 1;
+		argv = ealloc(2 * sizeof (char *));
+		argv[0] = "es";
+		argv[1] = NULL;
+	}
+	status = exitflush(esmain(argc, argv, FALSE));
+	if (startuptimes != NULL)
+		reportphases();
+	return status;
+}
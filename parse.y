@@ -73,7 +73,7 @@ cmdsan	: cmdsa			{ $$ = $1; }
 cmd	:		%prec LET		{ $$ = NULL; }
 	| simple				{ $$ = redirect(p, $1); if ($$ == &errornode) YYABORT; }
 	| redir cmd	%prec '!'		{ $$ = redirect(p, mk(nRedir, $1, $2)); if ($$ == &errornode) YYABORT; }
-	| first assign				{ $$ = mk(nAssign, $1, $2); }
+	| first assign				{ $$ = mk(nAssign, mkname($1), $2); }
 	| fn					{ $$ = $1; }
 	| binder nl '(' bindings ')' nl cmd	{ $$ = mk($1, $4, $7); }
 	| cmd ANDAND nl cmd			{ $$ = mkseq("%and", $1, $4); }
@@ -108,31 +108,31 @@ bindings: binding			{ $$ = treecons($1, NULL); }
 
 binding	:				{ $$ = NULL; }
 	| fn				{ $$ = $1; }
-	| first assign			{ $$ = mk(nAssign, $1, $2); }
+	| first assign			{ $$ = mk(nAssign, mkname($1), $2); }
 
 assign	: caret '=' caret words		{ $$ = $4; }
 
-fn	: FN word params '{' body '}'	{ $$ = fnassign($2, mklambda($3, $5)); }
-	| FN word			{ $$ = fnassign($2, NULL); }
+fn	: FN word params '{' body '}'	{ $$ = fnassign(mkname($2), mklambda($3, $5)); }
+	| FN word			{ $$ = fnassign(mkname($2), NULL); }
 
 first	: comword			{ $$ = $1; }
-	| first '^' sword		{ $$ = mk(nConcat, $1, $3); }
+	| first '^' sword		{ $$ = mkconcat($1, $3); }
 
 sword	: comword			{ $$ = $1; }
 	| keyword			{ $$ = mk(nWord, $1); }
 
 word	: sword				{ $$ = $1; }
-	| word '^' sword		{ $$ = mk(nConcat, $1, $3); }
+	| word '^' sword		{ $$ = mkconcat($1, $3); }
 
 comword	: param				{ $$ = $1; }
 	| '(' nlwords ')'		{ $$ = $2; }
 	| '{' body '}'			{ $$ = thunkify($2); }
 	| '@' params '{' body '}'	{ $$ = mklambda($2, $4); }
-	| '$' sword			{ $$ = mk(nVar, $2); }
-	| '$' sword SUB words ')'	{ $$ = mk(nVarsub, $2, $4); }
+	| '$' sword			{ $$ = mk(nVar, mkname($2)); }
+	| '$' sword SUB words ')'	{ $$ = mk(nVarsub, mkname($2), $4); }
 	| CALL sword			{ $$ = mk(nCall, $2); }
-	| COUNT sword			{ $$ = mk(nCall, prefix("%count", treecons(mk(nVar, $2), NULL))); }
-	| FLAT sword			{ $$ = flatten(mk(nVar, $2), " "); }
+	| COUNT sword			{ $$ = mk(nCall, prefix("%count", treecons(mk(nVar, mkname($2)), NULL))); }
+	| FLAT sword			{ $$ = flatten(mk(nVar, mkname($2)), " "); }
 	| PRIM WORD			{ $$ = mk(nPrim, $2); }
 	| '`' sword			{ $$ = backquote(mk(nVar, mk(nWord, "ifs")), $2); }
 	| BFLAT sword			{ $$ = flatten(backquote(mk(nVar, mk(nWord, "ifs")), $2), " "); }
@@ -143,7 +143,7 @@ param	: WORD				{ $$ = mk(nWord, $1); }
 	| QWORD				{ $$ = mk(nQword, $1); }
 
 params	:				{ $$ = NULL; }
-	| params param			{ $$ = treeconsend($1, $2); }
+	| params param			{ $$ = treeconsend($1, mkname($2)); }
 
 words	:				{ $$ = NULL; }
 	| words word			{ $$ = treeconsend($1, $2); }
@@ -23,6 +23,13 @@ PRIM(echo) {
 	return ltrue;
 }
 
+PRIM(flush) {
+	if (list != NULL)
+		fail("$&flush", "usage: %flush");
+	flushout();
+	return ltrue;
+}
+
 PRIM(count) {
 	return mklist(mkstr(str("%d", length(list))), NULL);
 }
@@ -166,6 +173,18 @@ PRIM(exitonfalse) {
 	return eval(list, NULL, evalflags | eval_exitonfalse);
 }
 
+/*
+ * streaming -- can the batch loop bypass %parse?  true when both %parse
+ *	and the %is-interactive it consults have their initial definitions,
+ *	in which case %parse in a batch shell is exactly $&parse.
+ */
+static Boolean streaming(int evalflags) {
+	return (evalflags & eval_exitonfalse) == 0
+		&& !isinteractive()
+		&& isinternal("fn-%parse")
+		&& isinternal("fn-%is-interactive");
+}
+
 PRIM(batchloop) {
 	Ref(List *, result, ltrue);
 	Ref(List *, dispatch, NULL);
@@ -176,6 +195,22 @@ PRIM(batchloop) {
 
 		for (;;) {
 			List *parser, *cmd;
+			dispatch = varlookup("fn-%dispatch", NULL);
+			if (dispatch == NULL && streaming(evalflags)) {
+				/*
+				 * %parse would only call $&parse, and there is
+				 * nothing to dispatch through, so run the tree
+				 * straight from the parser without wrapping it
+				 * in a closure or calling any es code.
+				 */
+				Tree *tree = parse(NULL);
+				SIGCHK();
+				if (tree != NULL) {
+					result = walk(tree, NULL, evalflags);
+					SIGCHK();
+				}
+				continue;
+			}
 			parser = varlookup("fn-%parse", NULL);
 			cmd = (parser == NULL)
 					? prim("parse", NULL, 0)
@@ -202,6 +237,13 @@ PRIM(batchloop) {
 	EndExceptionHandler
 }
 
+PRIM(dumpimage) {
+	if (list == NULL || list->next != NULL)
+		fail("$&dumpimage", "usage: %%dumpimage file");
+	dumpimage(getstr(list->term));
+	return ltrue;
+}
+
 PRIM(collect) {
 	gc();
 	return ltrue;
@@ -272,6 +314,7 @@ PRIM(setmaxevaldepth) {
 
 extern Dict *initprims_etc(Dict *primdict) {
 	X(echo);
+	X(flush);
 	X(count);
 	X(version);
 	X(exec);
@@ -284,6 +327,7 @@ extern Dict *initprims_etc(Dict *primdict) {
 	X(parse);
 	X(batchloop);
 	X(collect);
+	X(dumpimage);
 	X(home);
 	X(setnoexport);
 	X(vars);
@@ -1,5 +1,10 @@
 /* prim-io.c -- input/output and redirection primitives ($Revision: 1.2 $) */
 
+#define	_GNU_SOURCE	1	/* for F_GET_SEALS */
+#define	REQUIRE_STAT	1
+#define	REQUIRE_FCNTL	1
+#define	REQUIRE_MMAN	1
+
 #include "es.h"
 #include "gc.h"
 #include "prim.h"
@@ -32,6 +37,7 @@ static List *redir(List *(*rop)(int *fd, List *list), List *list, int evalflags)
 		   : defer_mvfd(inparent, srcfd, destfd);
 	ExceptionHandler
 		lp = eval(lp, NULL, evalflags);
+		flushout();
 		undefer(ticket);
 	CatchException (e)
 		undefer(ticket);
@@ -159,8 +165,38 @@ static int pipefork(int p[2], int *extra) {
 	return pid;
 }
 
+/*
+ * here documents
+ *	a short document fits in a pipe's buffer, so it is written there
+ *	directly.  a longer one goes into an anonymous scratch file, which
+ *	the command can read, seek or map like any other file; only if
+ *	no such file can be made does a child feed the document through
+ *	a pipe.
+ */
+
+/* herefile -- put a document in a scratch file, returning its fd or -1 */
+static int herefile(const char *doc, size_t len) {
+	int fd = anonfile("here");
+
+	if (fd == -1)
+		return -1;
+	while (len > 0) {
+		long n = write(fd, doc, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+		doc += n;
+		len -= n;
+	}
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
 PRIM(here) {
-	int fd, doclen, p[2], status, ticket = UNREGISTERED;
+	int fd, src, doclen, p[2], status, ticket;
 	volatile int pid = -1;
 	List *tail, **tailp;
 
@@ -176,36 +212,39 @@ PRIM(here) {
 
 	Ref(List *, cmd, tail);
 	Ref(char *, doc, (lp == tail) ? NULL : str("%L", lp, ""));
-	doclen = strlen(doc);
+	doclen = (doc == NULL) ? 0 : strlen(doc);
 
 #ifdef PIPE_BUF
 	if (doclen <= PIPE_BUF) {
 		if (pipe(p) == -1)
 			fail("$&here", "pipe: %s", esstrerror(errno));
 		ewrite(p[1], doc, doclen);
+		close(p[1]);
+		src = p[0];
 	} else
 #endif
-	if ((pid = pipefork(p, NULL)) == 0) {	/* child that writes to pipe */
-		close(p[0]);
-		ewrite(p[1], doc, doclen);
-		esexit(0);
+	if ((src = herefile(doc, doclen)) == -1) {
+		if ((pid = pipefork(p, NULL)) == 0) {	/* child that writes to pipe */
+			close(p[0]);
+			ewrite(p[1], doc, doclen);
+			esexit(0);
+		}
+		close(p[1]);
+		src = p[0];
 	}
 
-	close(p[1]);
-	ticket = defer_mvfd(TRUE, p[0], fd);
+	ticket = defer_mvfd(TRUE, src, fd);
 
 	ExceptionHandler
 		lp = eval(cmd, NULL, evalflags);
 	CatchException (e)
 		undefer(ticket);
-		close(p[0]);
 		if (pid > 0)
 			ewaitfor(pid);
 		throw(e);
 	EndExceptionHandler
 
 	undefer(ticket);
-	close(p[0]);
 	if (pid > 0) {
 		status = ewaitfor(pid);
 		printstatus(0, status);
@@ -214,61 +253,164 @@ PRIM(here) {
 	RefReturn(lp);
 }
 
+#if HAVE_POSIX_SPAWN
+/*
+ * spawnstage -- start a pipeline stage which only runs an external
+ *	program with posix_spawn(), creating its output pipe in p unless
+ *	outfd is -1.  returns the pid, or 0 if the stage must be forked.
+ */
+static int spawnstage(Term *term, int infd, int inpipe, int outfd, int p[2]) {
+	int pid = 0;
+	Ref(char *, file, NULL);
+	Ref(List *, args, externalcommand(term, &file));
+	if (args != NULL && outfd != -1 && cloexecpipe(p) == -1)
+		fail(caller, "pipe: %s", esstrerror(errno));
+	if (args != NULL
+	    && (inpipe == -1 || (inpipe != infd && inpipe != outfd))
+	    && (outfd == -1 || (p[0] != infd && p[1] != infd
+				&& p[0] != outfd && p[1] != outfd))) {
+		int moves[5], *mp = moves;
+		if (inpipe != -1) {
+			registerfd(&inpipe, FALSE);
+			*mp++ = inpipe;
+			*mp++ = infd;
+		}
+		if (outfd != -1) {
+			registerfd(&p[0], FALSE);
+			registerfd(&p[1], FALSE);
+			*mp++ = p[1];
+			*mp++ = outfd;
+		}
+		*mp = -1;
+
+		gcdisable();
+		pid = espawn(file, vectorize(args)->vector, mkenv()->vector, moves);
+		gcenable();
+
+		if (outfd != -1) {
+			unregisterfd(&p[1]);
+			unregisterfd(&p[0]);
+		}
+		if (inpipe != -1)
+			unregisterfd(&inpipe);
+	}
+	if (pid == 0 && args != NULL && outfd != -1) {
+		close(p[0]);
+		close(p[1]);
+	}
+	RefEnd2(args, file);
+	return pid;
+}
+#endif
+
+/* pipelast -- run the last stage of a pipeline in this shell */
+static List *pipelast(Term *term, int infd, int inpipe, int evalflags) {
+	volatile int ticket = UNREGISTERED;
+
+	ticket = defer_mvfd((evalflags & eval_inchild) == 0, inpipe, infd);
+	Ref(List *, result, NULL);
+	ExceptionHandler
+		result = eval1(term, evalflags &~ eval_inchild);
+		undefer(ticket);
+	CatchException (e)
+		undefer(ticket);
+		throw(e);
+	EndExceptionHandler
+	RefReturn(result);
+}
+
 PRIM(pipe) {
-	int n, infd, inpipe;
-	static int *pids = NULL, pidmax = 0;
+	int pidbuf[8];
+	int *volatile pids;
+	volatile int n, infd, inpipe;
+	Boolean lastpipe;
 
 	caller = "$&pipe";
 	n = length(list);
 	if ((n % 3) != 1)
 		fail("$&pipe", "usage: pipe cmd [ outfd infd cmd ] ...");
 	n = (n + 2) / 3;
-	if (n > pidmax) {
-		pids = erealloc(pids, n * sizeof *pids);
-		pidmax = n;
-	}
+	/* not static: finding a program to spawn may run a nested pipe */
+	pids = (n <= arraysize(pidbuf)) ? pidbuf : ealloc(n * sizeof *pids);
 	n = 0;
 
 	infd = inpipe = -1;
+	/* primitives see no lexical bindings, so this must be a global (or local) */
+	lastpipe = varlookup("lastpipe", NULL) != NULL;
 
-	for (;; list = list->next) {
-		int p[2], pid;
+	Ref(List *, result, NULL);
+	Ref(List *, lp, list);
+	ExceptionHandler
 
-		pid = (list->next == NULL) ? efork(TRUE, FALSE) : pipefork(p, &inpipe);
+		for (;; lp = lp->next) {
+			int p[2], pid = 0, in = inpipe;
 
-		if (pid == 0) {		/* child */
-			if (inpipe != -1) {
-				assert(infd != -1);
-				releasefd(infd);
-				mvfd(inpipe, infd);
+			if (lastpipe && lp->next == NULL && in != -1) {
+				inpipe = -1;
+				result = pipelast(lp->term, infd, in, evalflags);
+				break;
 			}
-			if (list->next != NULL) {
-				int fd = getnumber(getstr(list->next->term));
-				releasefd(fd);
-				mvfd(p[1], fd);
-				close(p[0]);
+
+#if HAVE_POSIX_SPAWN
+			pid = spawnstage(lp->term, infd, in,
+					 lp->next == NULL
+					     ? -1 : getnumber(getstr(lp->next->term)),
+					 p);
+#endif
+			if (pid == 0) {
+				pid = (lp->next == NULL) ? efork(TRUE, FALSE) : pipefork(p, &in);
+
+				if (pid == 0) {		/* child */
+					n = 0;		/* the earlier stages are not ours */
+					if (in != -1) {
+						assert(infd != -1);
+						releasefd(infd);
+						mvfd(in, infd);
+					}
+					if (lp->next != NULL) {
+						int fd = getnumber(getstr(lp->next->term));
+						releasefd(fd);
+						mvfd(p[1], fd);
+						close(p[0]);
+					}
+					esexit(exitstatus(eval1(lp->term, evalflags | eval_inchild)));
+				}
 			}
-			esexit(exitstatus(eval1(list->term, evalflags | eval_inchild)));
+			pids[n++] = pid;
+			if (in != -1)
+				close(in);
+			inpipe = -1;
+			if (lp->next == NULL)
+				break;
+			lp = lp->next->next;
+			infd = getnumber(getstr(lp->term));
+			inpipe = p[0];
+			close(p[1]);
 		}
-		pids[n++] = pid;
+
+	CatchException (e)
+
+		/* closing the last pipe lets the stages already started finish */
 		if (inpipe != -1)
 			close(inpipe);
-		if (list->next == NULL)
-			break;
-		list = list->next->next;
-		infd = getnumber(getstr(list->term));
-		inpipe = p[0];
-		close(p[1]);
-	}
+		while (0 < n)
+			ewaitfor(pids[--n]);
+		if (pids != pidbuf)
+			efree(pids);
+		throw(e);
 
-	Ref(List *, result, NULL);
-	do {
+	EndExceptionHandler
+	RefEnd(lp);
+
+	while (0 < n) {
 		Term *t;
 		int status = ewaitfor(pids[--n]);
 		printstatus(0, status);
-		t = mkstr(mkstatus(status));
+		t = mkstatusterm(status);
 		result = mklist(t, result);
-	} while (0 < n);
+	}
+	if (pids != pidbuf)
+		efree(pids);
 	if (evalflags & eval_inchild)
 		esexit(exitstatus(result));
 	RefReturn(result);
@@ -376,17 +518,216 @@ restart:
 	return endsplit();
 }
 
-PRIM(backquote) {
-	int pid, p[2], status;
+/*
+ * in-process backquote
+ *	a command whose only effect is its output can be run without
+ *	forking, writing to a scratch file in place of a pipe.  what
+ *	can be run this way is decided by looking at the code before
+ *	running it:  only primitives on the list below, functions built
+ *	from them, and lexical bindings are allowed, so no assignment,
+ *	redirection, external program, or other change to the shell
+ *	can happen.
+ */
+
+#define	MAXPUREDEPTH	8
+
+static const char *pureprims[] = {
+	"count", "echo", "flatten", "fsplit", "if", "result", "seq",
+	"split", "var", "version", NULL
+};
+
+/* those of the above that run their arguments as commands */
+static const char *evalprims[] = { "if", "seq", NULL };
+
+static Boolean purecmd(Tree *tree, Binding *binding, int depth);
+
+/* inlist -- is the name one of a NULL-terminated list of names? */
+static Boolean inlist(const char *name, const char **names) {
+	for (; *names != NULL; names++)
+		if (streq(name, *names))
+			return TRUE;
+	return FALSE;
+}
 
-	caller = "$&backquote";
-	if (list == NULL)
-		fail(caller, "usage: backquote separator command [args ...]");
+/* pureprim -- is this one of the primitives allowed in process? */
+static Boolean pureprim(const char *name) {
+	return inlist(name, pureprims);
+}
 
-	Ref(List *, lp, list);
-	Ref(char *, sep, getstr(lp->term));
-	lp = lp->next;
+/* evalsargs -- is the head of a command a primitive that runs its arguments? */
+static Boolean evalsargs(Tree *head, Binding *binding) {
+	List *fn;
+	Closure *cp;
+	switch (head->kind) {
+	    case nPrim:
+		return inlist(head->u[0].s, evalprims);
+	    case nWord: case nQword:
+		fn = varlookup2("fn-", head->u[0].s, binding);
+		return fn != NULL && fn->next == NULL
+		    && (cp = getclosure(fn->term)) != NULL
+		    && cp->tree->kind == nPrim
+		    && inlist(cp->tree->u[0].s, evalprims);
+	    default:
+		return FALSE;
+	}
+}
+
+/*
+ * pureargs -- are the arguments of if or seq pure as commands?  the
+ *	value of a variable or call could be any code at all, so only
+ *	code written out in place is allowed.
+ */
+static Boolean pureargs(Tree *args, Binding *binding, int depth) {
+	for (; args != NULL; args = args->u[1].p) {
+		Tree *arg = args->kind == nList ? args->u[0].p : args;
+		switch (arg->kind) {
+		    case nWord: case nQword: case nPrim: case nThunk: case nLambda:
+			if (!purecmd(arg, binding, depth))
+				return FALSE;
+			break;
+		    default:
+			return FALSE;
+		}
+		if (args->kind != nList)
+			break;
+	}
+	return TRUE;
+}
+
+/* purevalue -- can globbing this tree only run allowed commands? */
+static Boolean purevalue(Tree *tree, Binding *binding, int depth) {
+	for (; tree != NULL; tree = tree->u[1].p)
+		switch (tree->kind) {
+		    case nWord: case nQword: case nPrim:
+			return TRUE;
+		    case nThunk: case nLambda: case nCall:
+			return purecmd(tree, binding, depth);
+		    case nVar:
+			return purevalue(tree->u[0].p, binding, depth);
+		    case nVarsub: case nConcat: case nList:
+			if (!purevalue(tree->u[0].p, binding, depth))
+				return FALSE;
+			break;
+		    default:
+			return FALSE;
+		}
+	return TRUE;
+}
+
+/* purebindings -- are the bindings of a let or for free of effects? */
+static Boolean purebindings(Tree *defn, Binding *binding, int depth) {
+	for (; defn != NULL; defn = defn->u[1].p) {
+		Tree *assign = defn->u[0].p, *name;
+		if (assign == NULL)
+			continue;
+		/* a lexical function would hide the one we check */
+		for (name = assign->u[0].p; name != NULL; name = name->u[1].p) {
+			Tree *word = name->kind == nList ? name->u[0].p : name;
+			if ((word->kind != nWord && word->kind != nQword)
+			    || hasprefix(word->u[0].s, "fn-"))
+				return FALSE;
+			if (name->kind != nList)
+				break;
+		}
+		if (!purevalue(assign->u[1].p, binding, depth))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* purefn -- does calling this function definition only run allowed commands? */
+static Boolean purefn(List *defn, int depth) {
+	Closure *cp;
+	if (defn->next != NULL || (cp = getclosure(defn->term)) == NULL)
+		return FALSE;
+	switch (cp->tree->kind) {
+	    case nPrim:
+		return pureprim(cp->tree->u[0].s);
+	    case nThunk:
+		return purecmd(cp->tree->u[0].p, cp->binding, depth + 1);
+	    case nLambda:
+		return purecmd(cp->tree->u[1].p, cp->binding, depth + 1);
+	    default:
+		return FALSE;
+	}
+}
 
+/* purecmd -- does running this tree only run allowed commands? */
+static Boolean purecmd(Tree *tree, Binding *binding, int depth) {
+	List *fn;
+	if (depth > MAXPUREDEPTH)
+		return FALSE;
+	if (tree == NULL)
+		return TRUE;
+	switch (tree->kind) {
+	    case nList:
+		return (evalsargs(tree->u[0].p, binding)
+			    ? pureargs(tree->u[1].p, binding, depth)
+			    : purevalue(tree->u[1].p, binding, depth))
+		    && purecmd(tree->u[0].p, binding, depth);
+	    case nWord: case nQword:
+		fn = varlookup2("fn-", tree->u[0].s, binding);
+		return fn != NULL && purefn(fn, depth);
+	    case nPrim:
+		return pureprim(tree->u[0].s);
+	    case nThunk: case nCall:
+		return purecmd(tree->u[0].p, binding, depth);
+	    case nLambda:
+		return purecmd(tree->u[1].p, binding, depth);
+	    case nLet: case nClosure: case nFor:
+		return purebindings(tree->u[0].p, binding, depth)
+		    && purecmd(tree->u[1].p, binding, depth);
+	    case nMatch: case nExtract:
+		return purevalue(tree->u[0].p, binding, depth)
+		    && purevalue(tree->u[1].p, binding, depth);
+	    default:
+		return FALSE;
+	}
+}
+
+/* bqinprocess -- run a pure command with its output going to a memory file */
+static List *bqinprocess(char *sep0, List *cmd, int evalflags) {
+	int fd, status;
+	volatile int ticket = UNREGISTERED;
+
+	fd = anonfile("backquote");
+	if (fd == -1)
+		fail("$&backquote", "scratch file: %s", esstrerror(errno));
+	ticket = defer_mvfd(TRUE, fd, 1);
+
+	Ref(List *, lp, cmd);
+	Ref(char *, sep, sep0);
+	ExceptionHandler
+		status = exitstatus(eval(lp, NULL, evalflags &~ eval_inchild));
+	CatchException (e)
+		if (!termeq(e->term, "error")) {
+			undefer(ticket);
+			throw(e);
+		}
+		/* report the error the way a child would */
+		eprint("%L\n", e->next == NULL ? NULL : e->next->next, " ");
+		status = 1;
+	EndExceptionHandler
+
+	fd = dup(fdmap(1));
+	undefer(ticket);
+	if (fd == -1)
+		fail("$&backquote", "dup: %s", esstrerror(errno));
+	lseek(fd, 0, SEEK_SET);
+	gcdisable();
+	lp = bqinput(sep, fd);
+	close(fd);
+	lp = mklist(mkstatusterm(status << 8), lp);
+	gcenable();
+	RefEnd(sep);
+	RefReturn(lp);
+}
+
+/* bqchild -- run a command in a child with its output going to a pipe */
+static List *bqchild(const char *sep, List *cmd, int evalflags) {
+	int pid, p[2], status;
+
+	Ref(List *, lp, cmd);
 	if ((pid = pipefork(p, NULL)) == 0) {
 		mvfd(p[1], 1);
 		close(p[0]);
@@ -399,8 +740,32 @@ PRIM(backquote) {
 	close(p[0]);
 	status = ewaitfor(pid);
 	printstatus(0, status);
-	lp = mklist(mkstr(mkstatus(status)), lp);
+	lp = mklist(mkstatusterm(status), lp);
 	gcenable();
+	RefReturn(lp);
+}
+
+PRIM(backquote) {
+	Boolean inprocess = FALSE;
+
+	caller = "$&backquote";
+	if (list == NULL)
+		fail(caller, "usage: backquote separator command [args ...]");
+
+	Ref(List *, lp, list);
+	Ref(char *, sep, getstr(lp->term));
+	lp = lp->next;
+
+	if (lp != NULL && lp->next == NULL && !(evalflags & eval_exitonfalse)) {
+		Closure *cp = getclosure(lp->term);
+		inprocess = cp != NULL && cp->tree->kind == nThunk
+			    && purecmd(cp->tree->u[0].p, cp->binding, 0);
+	}
+	if (inprocess)
+		lp = bqinprocess(sep, lp, evalflags);
+	else
+		lp = bqchild(sep, lp, evalflags);
+
 	list = lp;
 	RefEnd2(sep, lp);
 	SIGCHK();
@@ -441,7 +806,10 @@ static int readn(int fd, char *s, size_t n) {
 PRIM(read) {
 	int c;
 	int fd = fdmap(0);
-	Buffer *buffer = openbuffer(0);
+	Buffer *buffer;
+
+	flushout();
+	buffer = openbuffer(0);
 	Ref(List *, result, NULL);
 
 #if HAVE_LSEEK
@@ -491,6 +859,502 @@ PRIM(read) {
 	RefReturn(result);
 }
 
+/*
+ * buffered line readers
+ *	$&readlines reads large blocks from a descriptor and hands out
+ *	lines from them, so it consumes input beyond the lines returned.
+ *	for a seekable file, the block buffer belongs to a private
+ *	duplicate of the descriptor, which is reserved so that it is
+ *	closed in children and moved out of the way of redirections.
+ *	a pipe, socket or terminal is never duplicated, since holding it
+ *	open would keep a writer from seeing the reader go away; its
+ *	reader reads from the user's fd and is only remembered by file
+ *	identity.  a reader is used again only while the descriptor
+ *	still refers to the same open file; at end of file it is
+ *	discarded.
+ */
+
+#define	READBLOCK	((size_t) 65536)
+
+typedef struct LineReader LineReader;
+struct LineReader {
+	int fd;			/* private duplicate of the user's fd, or -1 */
+	int userfd;
+	Boolean seekable;
+	dev_t dev;
+	ino_t ino;
+	size_t pos, len;	/* unread data in buf */
+	size_t linelen, linemax;	/* partial line, kept across calls */
+	char *buf, *line;
+	LineReader *next;
+};
+
+static LineReader *linereaders = NULL;
+
+/* dropreader -- discard a line reader */
+static void dropreader(LineReader *r) {
+	LineReader **rp;
+	for (rp = &linereaders; *rp != r; rp = &(*rp)->next)
+		;
+	*rp = r->next;
+	if (r->seekable) {
+		unregisterfd(&r->fd);
+		if (r->fd != -1)
+			close(r->fd);
+	}
+	if (r->line != NULL)
+		efree(r->line);
+	efree(r->buf);
+	efree(r);
+}
+
+/* getreader -- find or make the line reader for a user fd */
+static LineReader *getreader(int userfd) {
+	int fd = fdmap(userfd);
+	off_t offset;
+	struct stat st;
+	LineReader *r;
+
+	if (fd == -1 || fstat(fd, &st) == -1)
+		fail(caller, "%d: %s", userfd, esstrerror(fd == -1 ? EBADF : errno));
+	offset = lseek(fd, 0, SEEK_CUR);
+	for (r = linereaders; r != NULL; r = r->next)
+		if (r->userfd == userfd) {
+			/* a file opened again has the same inode but its own offset */
+			if (
+				r->dev == st.st_dev && r->ino == st.st_ino
+			     && (r->seekable
+				    ? r->fd != -1 && offset == lseek(r->fd, 0, SEEK_CUR)
+				    : offset == -1)
+			)
+				return r;
+			dropreader(r);
+			break;
+		}
+
+	if (offset != -1) {
+		if ((fd = dup(fd)) == -1)
+			fail(caller, "%d: %s", userfd, esstrerror(errno));
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	} else
+		fd = -1;
+	r = ealloc(sizeof (LineReader));
+	memzero(r, sizeof (LineReader));
+	r->fd = fd;
+	r->userfd = userfd;
+	r->seekable = (offset != -1);
+	r->dev = st.st_dev;
+	r->ino = st.st_ino;
+	r->buf = ealloc(READBLOCK);
+	r->next = linereaders;
+	linereaders = r;
+	if (r->seekable)
+		registerfd(&r->fd, TRUE);
+	return r;
+}
+
+/* refill -- read the next block, returning FALSE at end of file */
+static Boolean refill(LineReader *r) {
+	long nread;
+	int fd = r->seekable ? r->fd : fdmap(r->userfd);
+	do {
+		nread = read(fd, r->buf, READBLOCK);
+		SIGCHK();
+	} while (nread == -1 && errno == EINTR);
+	if (nread == -1)
+		fail(caller, "%s", esstrerror(errno));
+	r->pos = 0;
+	r->len = nread;
+	return nread > 0;
+}
+
+/* keep -- add to the partial line, skipping NULs as %read does */
+static void keep(LineReader *r, const char *s, size_t n) {
+	if (r->linelen + n > r->linemax) {
+		r->linemax = (r->linelen + n) * 2;
+		r->line = erealloc(r->line, r->linemax);
+	}
+	for (; n > 0; s++, n--)
+		if (*s != '\0')
+			r->line[r->linelen++] = *s;
+}
+
+/* readline1 -- take one line from a reader, or NULL at end of file */
+static char *readline1(LineReader *r) {
+	char *s;
+	for (;;) {
+		char *start, *nl;
+		size_t n;
+		if (r->pos == r->len && !refill(r)) {
+			if (r->linelen == 0)
+				return NULL;
+			break;
+		}
+		start = r->buf + r->pos;
+		nl = memchr(start, '\n', r->len - r->pos);
+		n = (nl == NULL ? r->buf + r->len : nl) - start;
+		r->pos += n + (nl != NULL);
+		if (nl != NULL && r->linelen == 0 && memchr(start, '\0', n) == NULL)
+			return gcndup(start, n);
+		keep(r, start, n);
+		if (nl != NULL)
+			break;
+	}
+	s = gcndup(r->line, r->linelen);
+	r->linelen = 0;
+	return s;
+}
+
+PRIM(readlines) {
+	int i, n;
+	LineReader *r;
+
+	caller = "$&readlines";
+	if (length(list) != 2)
+		argcount("%readlines fd n");
+	flushout();
+	r = getreader(getnumber(getstr(list->term)));
+	n = getnumber(getstr(list->next->term));
+
+	Ref(List *, result, NULL);
+	for (i = 0; i < n; i++) {
+		Term *term;
+		char *line = readline1(r);
+		if (line == NULL) {
+			dropreader(r);
+			break;
+		}
+		term = mkstr(line);
+		result = mklist(term, result);
+	}
+	result = reverse(result);
+	RefReturn(result);
+}
+
+/*
+ * reading whole files
+ *	%readfile opens a file and returns its contents without a fork
+ *	or a pipe.  a file that is sealed against shrinking is mapped, so
+ *	its bytes are copied only once, straight into the terms of the
+ *	result.  anything else is read, in one go when its size is known:
+ *	a mapped file that someone truncates raises SIGBUS.
+ */
+
+#if HAVE_MMAP && defined(F_GET_SEALS)
+#define	MAPSEALED	1
+#else
+#define	MAPSEALED	0
+#endif
+
+/* readall -- read everything from an fd into a malloc'd block; closes fd on error */
+static char *readall(int fd, size_t size, size_t *lenp) {
+	/* one byte more than the expected size finds the end without a realloc */
+	volatile size_t len = 0, max = size < READBLOCK ? READBLOCK : size + 1;
+	char * volatile data = ealloc(max);
+
+	ExceptionHandler
+		for (;;) {
+			long nread;
+			if (len == max) {
+				max *= 2;
+				data = erealloc(data, max);
+			}
+			nread = read(fd, data + len, max - len);
+			if (nread == -1) {
+				if (errno != EINTR)
+					fail(caller, "%s", esstrerror(errno));
+				SIGCHK();
+				continue;
+			}
+			if (nread == 0)
+				break;
+			len += nread;
+		}
+	CatchException (e)
+		efree(data);
+		close(fd);
+		throw(e);
+	EndExceptionHandler
+
+	*lenp = len;
+	return data;
+}
+
+#if MAPSEALED
+/* cannotshrink -- is the file sealed so that its mapped pages cannot go away? */
+static Boolean cannotshrink(int fd) {
+	int seals = fcntl(fd, F_GET_SEALS);
+	return seals != -1 && (seals & F_SEAL_SHRINK) != 0;
+}
+#endif
+
+/* contents -- the whole of a file as one term, without its NULs;  none if it is empty */
+static List *contents(const char *data, size_t len) {
+	Buffer *buf;
+	const char *s, *end = data + len;
+
+	if (len == 0)
+		return NULL;
+	if (memchr(data, '\0', len) == NULL)
+		return mklist(mkstr(gcndup(data, len)), NULL);
+	buf = openbuffer(len);
+	for (s = data; s < end; s++)
+		if (*s != '\0')
+			buf = bufputc(buf, *s);
+	return mklist(mkstr(sealcountedbuffer(buf)), NULL);
+}
+
+PRIM(readfile) {
+	int fd;
+	struct stat st;
+	char *name, *data;
+	size_t len;
+#if MAPSEALED
+	Boolean mapped = FALSE;
+#endif
+
+	caller = "$&readfile";
+	if (list == NULL || (list->next != NULL && list->next->next != NULL))
+		argcount("%readfile file [separator]");
+	name = getstr(list->term);
+	Ref(char *, sep, list->next == NULL ? NULL : getstr(list->next->term));
+	if ((fd = eopen(name, oOpen)) == -1)
+		fail(caller, "%s: %s", name, esstrerror(errno));
+	if (fstat(fd, &st) == -1) {
+		int err = errno;
+		close(fd);
+		fail(caller, "%s: %s", name, esstrerror(err));
+	}
+
+	data = NULL;
+#if MAPSEALED
+	if (S_ISREG(st.st_mode) && st.st_size > 0 && cannotshrink(fd)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+		else {
+			mapped = TRUE;
+			len = st.st_size;
+		}
+	}
+#endif
+	if (data == NULL)
+		/* files that report no size, such as many in /proc, are read in blocks */
+		data = readall(fd, S_ISREG(st.st_mode) ? st.st_size : 0, &len);
+	close(fd);
+
+	list = (sep == NULL) ? contents(data, len) : splitall(sep, data, len, TRUE);
+	RefEnd(sep);
+
+#if MAPSEALED
+	if (mapped)
+		munmap(data, len);
+	else
+#endif
+		efree(data);
+	return list;
+}
+
+/*
+ * coprocesses
+ *	a coprocess is a long-running child whose standard input and
+ *	output are pipes held by the shell, so that a script can send it
+ *	request lines and read back response lines without a fork per
+ *	request.  the shell's ends of the pipes are on the reserved list,
+ *	so they move out of the way of redirections and are closed in
+ *	every other child, and they are closed on exec.
+ */
+
+typedef struct Coproc Coproc;
+struct Coproc {
+	int pid;
+	int in, out;		/* the helper's output and input */
+	size_t pos, len;	/* unread data in buf */
+	Coproc *next;
+	char buf[BUFSIZE];
+};
+
+static Coproc *coprocs = NULL;
+
+/* findcoproc -- look up a coprocess by pid */
+static Coproc *findcoproc(List *list) {
+	int pid;
+	Coproc *c;
+	if (list == NULL)
+		fail(caller, "missing coprocess id");
+	pid = getnumber(getstr(list->term));
+	for (c = coprocs; c != NULL; c = c->next)
+		if (c->pid == pid) {
+			if (c->in == -1)
+				fail(caller, "coprocess %d belongs to the parent shell", pid);
+			return c;
+		}
+	fail(caller, "%d: no such coprocess", pid);
+}
+
+PRIM(coproc) {
+	int to[2], from[2];
+	volatile int pid = 0;
+
+	caller = "$&coproc";
+	if (list == NULL)
+		argcount("%coproc cmd");
+	Ref(List *, lp, list);
+	if (pipe(to) == -1)
+		fail(caller, "pipe: %s", esstrerror(errno));
+	if (pipe(from) == -1) {
+		close(to[0]);
+		close(to[1]);
+		fail(caller, "pipe: %s", esstrerror(errno));
+	}
+
+	registerfd(&to[0], FALSE);
+	registerfd(&to[1], FALSE);
+	registerfd(&from[0], FALSE);
+	registerfd(&from[1], FALSE);
+	ExceptionHandler
+		pid = efork(TRUE, TRUE);
+	CatchExceptionIf (pid != 0, e)
+		unregisterfd(&from[1]);
+		unregisterfd(&from[0]);
+		unregisterfd(&to[1]);
+		unregisterfd(&to[0]);
+		close(to[0]);
+		close(to[1]);
+		close(from[0]);
+		close(from[1]);
+		throw(e);
+	EndExceptionHandler
+	unregisterfd(&from[1]);
+	unregisterfd(&from[0]);
+	unregisterfd(&to[1]);
+	unregisterfd(&to[0]);
+
+	if (pid == 0) {
+		close(to[1]);
+		close(from[0]);
+		mvfd(to[0], 0);
+		mvfd(from[1], 1);
+		esexit(exitstatus(eval(lp, NULL, evalflags | eval_inchild)));
+	}
+	RefEnd(lp);
+
+	close(to[0]);
+	close(from[1]);
+	fcntl(to[1], F_SETFD, FD_CLOEXEC);
+	fcntl(from[0], F_SETFD, FD_CLOEXEC);
+
+	{
+		Coproc *c = ealloc(sizeof (Coproc));
+		c->pid = pid;
+		c->in = from[0];
+		c->out = to[1];
+		c->pos = c->len = 0;
+		c->next = coprocs;
+		coprocs = c;
+		registerfd(&c->in, TRUE);
+		registerfd(&c->out, TRUE);
+	}
+	return mklist(mkstr(str("%d", pid)), NULL);
+}
+
+PRIM(cosend) {
+	char *s;
+	long n, len;
+	Sigeffect pipeeffect;
+	Coproc *c;
+
+	caller = "$&cosend";
+	c = findcoproc(list);
+	s = str("%L\n", list->next, " ");
+	len = strlen(s);
+	/* a helper that has gone away is an error, not a reason to exit */
+	pipeeffect = esignal(SIGPIPE, sig_ignore);
+	while (len > 0) {
+		if ((n = write(c->out, s, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			esignal(SIGPIPE, pipeeffect);
+			fail(caller, "%d: %s", c->pid, esstrerror(errno));
+		}
+		s += n;
+		len -= n;
+	}
+	esignal(SIGPIPE, pipeeffect);
+	return ltrue;
+}
+
+PRIM(coread) {
+	char *nl;
+	size_t n;
+	Coproc *c;
+	Buffer *volatile buffer;
+
+	caller = "$&coread";
+	c = findcoproc(list);
+
+	/* the common case: the whole line is already buffered */
+	if ((nl = memchr(c->buf + c->pos, '\n', c->len - c->pos)) != NULL) {
+		char *line = c->buf + c->pos;
+		c->pos = nl + 1 - c->buf;
+		return mklist(mkstr(gcndup(line, nl - line)), NULL);
+	}
+
+	buffer = openbuffer(0);
+	ExceptionHandler
+		for (;;) {
+			long nread;
+			if (c->pos == c->len) {
+				c->pos = c->len = 0;
+				do {
+					nread = read(c->in, c->buf, sizeof c->buf);
+					SIGCHK();
+				} while (nread == -1 && errno == EINTR);
+				if (nread == -1)
+					fail(caller, "%d: %s", c->pid, esstrerror(errno));
+				if (nread == 0)
+					break;
+				c->len = nread;
+			}
+			nl = memchr(c->buf + c->pos, '\n', c->len - c->pos);
+			n = (nl == NULL ? c->len : (size_t) (nl - c->buf)) - c->pos;
+			buffer = bufncat(buffer, c->buf + c->pos, n);
+			c->pos += n;
+			if (nl != NULL) {
+				c->pos++;
+				break;
+			}
+		}
+	CatchException (e)
+		freebuffer(buffer);
+		throw(e);
+	EndExceptionHandler
+
+	if (nl == NULL && buffer->current == 0) {
+		freebuffer(buffer);
+		return NULL;
+	}
+	return mklist(mkstr(sealcountedbuffer(buffer)), NULL);
+}
+
+PRIM(coclose) {
+	int status;
+	Coproc *c, **cp;
+
+	caller = "$&coclose";
+	c = findcoproc(list);
+	for (cp = &coprocs; *cp != c; cp = &(*cp)->next)
+		;
+	*cp = c->next;
+	unregisterfd(&c->in);
+	unregisterfd(&c->out);
+	close(c->in);
+	close(c->out);
+	status = ewaitfor(c->pid);
+	efree(c);
+	return mklist(mkstatusterm(status), NULL);
+}
+
 extern Dict *initprims_io(Dict *primdict) {
 	X(openfile);
 	X(close);
@@ -504,5 +1368,11 @@ extern Dict *initprims_io(Dict *primdict) {
 	X(writeto);
 #endif
 	X(read);
+	X(readlines);
+	X(readfile);
+	X(coproc);
+	X(cosend);
+	X(coread);
+	X(coclose);
 	return primdict;
 }
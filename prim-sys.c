@@ -57,7 +57,7 @@ PRIM(fork) {
 	status = ewaitfor(pid);
 	SIGCHK();
 	printstatus(0, status);
-	return mklist(mkstr(mkstatus(status)), NULL);
+	return mklist(mkstatusterm(status), NULL);
 }
 
 PRIM(run) {
@@ -399,10 +399,14 @@ PRIM(time) {
 	printstatus(0, status);
 
 	subtimes(time, prev, &time);
+#if HAVE_WAIT4
+	/* only count the timed command, not other children reaped meanwhile */
+	jobtimes(&time.user_usec, &time.sys_usec);
+#endif
 	strtimes(time, lp);
 
 	RefEnd(lp);
-	return mklist(mkstr(mkstatus(status)), NULL);
+	return mklist(mkstatusterm(status), NULL);
 }
 #endif	/* BUILTIN_TIME */
 
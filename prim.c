@@ -13,6 +13,23 @@ extern List *prim(char *s, List *list, int evalflags) {
 	return (p->prim)(list, evalflags);
 }
 
+/* lookupprim -- find a primitive by name, or NULL if there is none */
+extern Prim *lookupprim(const char *s) {
+	if (prims == NULL)
+		return NULL;
+	return (Prim *) dictget(prims, s);
+}
+
+/* primcall -- call the primitive named by an nPrim node */
+extern List *primcall(Tree *tree, List *list, int evalflags) {
+	Prim *p;
+	assert(tree->kind == nPrim);
+	p = tree->u[1].prim;
+	if (p == NULL)
+		return prim(tree->u[0].s, list, evalflags);
+	return (p->prim)(list, evalflags);
+}
+
 static const char *list_prefix;
 
 static void listwithprefix(void *arg, char *key, void *value) {
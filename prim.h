@@ -1,6 +1,6 @@
 /* prim.h -- definitions for es primitives ($Revision: 1.1.1.1 $) */
 
-typedef struct { List *(*prim)(List *, int); } Prim;
+struct Prim { List *(*prim)(List *, int); };
 
 #define	PRIM(name)	static List *CONCAT(prim_,name)( \
 				List UNUSED *list, int UNUSED evalflags \
@@ -327,9 +327,139 @@ static int fdprint(Format *format, int fd, const char *fmt) {
 	return err;
 }
 
+
+/*
+ * buffered standard output
+ *	print() collects output for fd 1 in a buffer that lives across
+ *	calls, so that a loop of echos makes one write per OUTBUFSIZE
+ *	bytes rather than one per line.  the buffer goes out when it fills,
+ *	at each newline if fd 1 is a terminal, and when fd 1 is redirected
+ *	elsewhere; the rest of the shell calls flushout() before it forks,
+ *	execs, reads, moves or closes descriptors, or writes to another fd,
+ *	and the buffer is written at exit.  a write error at a normal exit
+ *	is reported and fails the shell; quietflush() is for the rest.
+ *	a fatal signal that arrives while the buffer is being changed is
+ *	held until the change is done, so that sigflush() sees it whole.
+ */
+
+#define	OUTBUFSIZE	8192
+
+static char outbuf[OUTBUFSIZE];
+static size_t outlen = 0;
+static int outfd = -1, outerr = 0;
+static Boolean outtty = FALSE;
+static Atomic outbusy = 0, outsig = 0;
+
+/* lockout -- start changing the buffer */
+static void lockout(void) {
+	outbusy++;
+}
+
+/* unlockout -- done changing the buffer;  die of any signal held meanwhile */
+static void unlockout(void) {
+	if (--outbusy == 0 && outsig != 0) {
+		int sig = outsig;
+		outsig = 0;
+		kill(getpid(), sig);
+	}
+}
+
+/* writeout -- empty the buffer, returning 0 or an errno */
+static int writeout(void) {
+	char *s = outbuf;
+	size_t n = outlen;
+	int err = 0;
+
+	lockout();
+	outlen = 0;
+	while (n > 0) {
+		long written = write(outfd, s, n);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
+			break;
+		}
+		s += written;
+		n -= written;
+	}
+	unlockout();
+	return err;
+}
+
+/* quietflush -- write out buffered output, ignoring errors; for use at exit and in cleanup */
+extern void quietflush(void) {
+	if (outlen > 0)
+		writeout();
+	outfd = -1;
+}
+
+/*
+ * sigflush -- write out buffered output from a handler for a fatal signal,
+ *	or hold the signal and return FALSE if the buffer is being changed
+ */
+extern Boolean sigflush(int sig) {
+	char *s = outbuf;
+	size_t n = outlen;
+	if (outbusy) {
+		outsig = sig;
+		return FALSE;
+	}
+	if (outfd == -1)
+		return TRUE;
+	while (n > 0) {
+		long written = write(outfd, s, n);
+		if (written <= 0)
+			break;
+		s += written;
+		n -= written;
+	}
+	return TRUE;
+}
+
+/* flushout -- write out buffered output */
+extern void flushout(void) {
+	int err = (outlen > 0) ? writeout() : 0;
+	outfd = -1;
+	if (err != 0)
+		fail("es:flush", "flush: %s", esstrerror(err));
+}
+
+/*
+ * exitflush -- write out buffered output before exiting normally.  a
+ *	failure is reported, as it would have been without the buffer,
+ *	and turns a successful exit status into a failing one.
+ */
+extern int exitflush(int status) {
+	int err = (outlen > 0) ? writeout() : 0;
+	outfd = -1;
+	if (err != 0) {
+		ExceptionHandler
+			eprint("print: %s\n", esstrerror(err));
+		CatchException (e)
+			(void) e;	/* stderr is no better; the status has to do */
+		EndExceptionHandler
+		if (status == 0)
+			status = 1;
+	}
+	return status;
+}
+
+static int print_grow(Format *format, size_t UNUSED more) {
+	outlen = format->buf - format->bufbegin;
+	format->flushed += outlen;
+	format->buf = format->bufbegin;
+	if (outerr == 0)
+		outerr = writeout();
+	else
+		outlen = 0;
+	return outerr;
+}
+
 extern int fprint VARARGS2(int, fd, const char *, fmt) {
 	int err;
 	Format format;
+	flushout();
 	VA_START(format.args, fmt);
 	err = fdprint(&format, fd, fmt);
 	va_end(format.args);
@@ -339,11 +469,48 @@ extern int fprint VARARGS2(int, fd, const char *, fmt) {
 }
 
 extern int print VARARGS1(const char *, fmt) {
-	int err;
+	int err, fd = fdmap(1);
 	Format format;
+	static Boolean registered = FALSE;
+
+	if (fd != outfd) {
+		flushout();
+		if (fd == -1) {
+			VA_START(format.args, fmt);
+			err = fdprint(&format, 1, fmt);
+			va_end(format.args);
+			fail("es:print", "print: %s", esstrerror(err));
+		}
+		if (!registered) {
+			registered = TRUE;
+			atexit(quietflush);
+		}
+		outfd = fd;
+		outtty = isatty(fd);
+	}
+
+	lockout();
+	format.buf	= outbuf + outlen;
+	format.bufbegin	= outbuf;
+	format.bufend	= outbuf + sizeof outbuf;
+	format.grow	= print_grow;
+	format.flushed	= -outlen;
+	outerr = 0;
+
 	VA_START(format.args, fmt);
-	err = fdprint(&format, 1, fmt);
+	gcdisable();
+	printfmt(&format, fmt);
+	gcenable();
 	va_end(format.args);
+
+	outlen = format.buf - outbuf;
+	format.flushed += outlen;
+	err = outerr;
+	if (err == 0 && outtty && memchr(outbuf, '\n', outlen) != NULL)
+		err = writeout();
+	if (err != 0)
+		outlen = 0;
+	unlockout();
 	if (err != 0)
 		fail("es:print", "print: %s", esstrerror(err));
 	return format.flushed;
@@ -352,6 +519,7 @@ extern int print VARARGS1(const char *, fmt) {
 extern int eprint VARARGS1(const char *, fmt) {
 	int err;
 	Format format;
+	flushout();
 	VA_START(format.args, fmt);
 	err = fdprint(&format, 2, fmt);
 	va_end(format.args);
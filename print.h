@@ -38,6 +38,10 @@ extern void fmtcat(Format *, const char *);
 extern int print(const char *fmt VARARGS);
 extern int eprint(const char *fmt VARARGS);
 extern int fprint(int fd, const char *fmt VARARGS);
+extern void flushout(void);
+extern void quietflush(void);
+extern int exitflush(int status);
+extern Boolean sigflush(int sig);
 
 extern char *strv(const char *fmt, va_list args);	/* varargs interface to str() */
 
@@ -1,17 +1,60 @@
 /* proc.c -- process control system calls ($Revision: 1.2 $) */
 
+#define	REQUIRE_SPAWN	1
+
 #include "es.h"
+#include "gc.h"
+
+#include <poll.h>
+
+#if HAVE_WAIT4
+#include <sys/time.h>
+#include <sys/resource.h>
+typedef struct rusage Usage;
+#define	waitchild(statusp, options, usagep) \
+	wait4(-1, statusp, options, usagep)
+#else
+typedef struct { long unused; } Usage;
+#define	waitchild(statusp, options, usagep) \
+	waitpid(-1, statusp, options)
+#endif
 
 Boolean hasforked = FALSE;
 
+/*
+ * the process table
+ *	every child the shell has not yet waited for has a Proc, found
+ *	by pid through a hash table.  a Proc is on the live list until
+ *	its death is collected from the kernel, and then on the dead
+ *	list, holding its status, until something waits for it or a
+ *	new child is given the same pid.  background jobs are also kept
+ *	in the order they were started, for $&apids.
+ */
+
 typedef struct Proc Proc;
 struct Proc {
 	int pid;
-	Boolean background;
-	Proc *next, *prev;
+	int status;
+	Usage usage;
+	Boolean alive, background;
+	Proc *next, *prev;	/* on the live or dead list */
+	Proc *chain;		/* in the hash bucket */
+	Proc *bgnext, *bgprev;	/* on the background list */
 };
 
-static Proc *proclist = NULL;
+#define	PROCHASHSIZE	256	/* must be a power of two */
+
+static Proc *proctab[PROCHASHSIZE];
+static Proc *livelist = NULL, *deadlist = NULL;
+static Proc *bgfirst = NULL, *bglast = NULL;
+static int nforeground = 0;
+
+/*
+ * jobusage sums the resources used by the processes of the last
+ *	foreground job:  it is cleared when a foreground process is
+ *	started while no other is outstanding, and by $&wait.
+ */
+static Usage jobusage;
 
 static int ttyfd = -1;
 static pid_t espgid;
@@ -19,34 +62,152 @@ static pid_t espgid;
 static pid_t tcpgid0;
 #endif
 
-/* mkproc -- create a Proc structure */
-extern Proc *mkproc(int pid, Boolean background) {
-	Proc *proc = ealloc(sizeof (Proc));
-	proc->next = proclist;
+#define	prochash(pid)	(&proctab[(pid) & (PROCHASHSIZE - 1)])
+
+/* findproc -- look up a child by pid */
+static Proc *findproc(int pid) {
+	Proc *proc;
+	for (proc = *prochash(pid); proc != NULL; proc = proc->chain)
+		if (proc->pid == pid)
+			return proc;
+	return NULL;
+}
+
+/* linkproc -- put a process at the head of a list */
+static void linkproc(Proc *proc, Proc **list) {
+	proc->prev = NULL;
+	proc->next = *list;
+	if (*list != NULL)
+		(*list)->prev = proc;
+	*list = proc;
+}
+
+/* unlinkproc -- take a process off the list it is on */
+static void unlinkproc(Proc *proc) {
+	if (proc->next != NULL)
+		proc->next->prev = proc->prev;
+	if (proc->prev != NULL)
+		proc->prev->next = proc->next;
+	else if (proc->alive)
+		livelist = proc->next;
+	else
+		deadlist = proc->next;
+}
+
+#if HAVE_WAIT4
+static void addtime(struct timeval *total, const struct timeval *t) {
+	total->tv_sec += t->tv_sec;
+	total->tv_usec += t->tv_usec;
+	if (total->tv_usec >= 1000000) {
+		total->tv_usec -= 1000000;
+		total->tv_sec++;
+	}
+}
+#endif
+
+/* addusage -- account for the resources used by a process */
+static void addusage(Usage *usage) {
+#if HAVE_WAIT4
+	Usage *total = &jobusage;
+	addtime(&total->ru_utime, &usage->ru_utime);
+	addtime(&total->ru_stime, &usage->ru_stime);
+	if (usage->ru_maxrss > total->ru_maxrss)
+		total->ru_maxrss = usage->ru_maxrss;
+	total->ru_majflt += usage->ru_majflt;
+	total->ru_nvcsw += usage->ru_nvcsw;
+	total->ru_nivcsw += usage->ru_nivcsw;
+#endif
+}
+
+/* notedeath -- move a process which has exited to the dead list */
+static void notedeath(int pid, int status, Usage *usage) {
+	Proc *proc = findproc(pid);
+	if (proc == NULL || !proc->alive)
+		return;		/* not started by this shell */
+	unlinkproc(proc);
+	proc->alive = FALSE;
+	proc->status = status;
+	proc->usage = *usage;
+	linkproc(proc, &deadlist);
+}
+
+/* reapchildren -- collect the status of every child which has exited */
+static void reapchildren(void) {
+	int pid, status;
+	Usage usage;
+	while ((pid = waitchild(&status, WNOHANG, &usage)) > 0)
+		notedeath(pid, status, &usage);
+}
+
+/* dropproc -- forget a process which has been waited for */
+static void dropproc(Proc *proc) {
+	Proc **pp;
+	for (pp = prochash(proc->pid); *pp != proc; pp = &(*pp)->chain)
+		assert(*pp != NULL);
+	*pp = proc->chain;
+	unlinkproc(proc);
+	if (!proc->background)
+		--nforeground;
+	else {
+		if (proc->bgprev != NULL)
+			proc->bgprev->bgnext = proc->bgnext;
+		else
+			bgfirst = proc->bgnext;
+		if (proc->bgnext != NULL)
+			proc->bgnext->bgprev = proc->bgprev;
+		else
+			bglast = proc->bgprev;
+	}
+	efree(proc);
+}
+
+/* addproc -- record a new child process */
+static void addproc(int pid, Boolean background) {
+	Proc **bucket = prochash(pid);
+	Proc *proc = findproc(pid);
+	if (proc != NULL) {
+		/* the kernel has given its pid away, so its status can no longer be asked for */
+		if (proc->background && !proc->alive)
+			printstatus(proc->pid, proc->status);
+		dropproc(proc);
+	}
+	proc = ealloc(sizeof (Proc));
 	proc->pid = pid;
+	proc->status = 0;
+	proc->alive = TRUE;
 	proc->background = background;
-	proc->prev = NULL;
-	return proc;
+	proc->chain = *bucket;
+	*bucket = proc;
+	linkproc(proc, &livelist);
+	if (!background && nforeground++ == 0)
+		memzero(&jobusage, sizeof jobusage);
+	if (background) {
+		proc->bgnext = NULL;
+		proc->bgprev = bglast;
+		if (bglast != NULL)
+			bglast->bgnext = proc;
+		else
+			bgfirst = proc;
+		bglast = proc;
+		/* don't let finished background jobs pile up as zombies */
+		reapchildren();
+	}
 }
 
 /* efork -- fork (if necessary) and clean up as appropriate */
 extern int efork(Boolean parent, Boolean background) {
+	flushout();
 	if (parent) {
 		int pid = fork();
 		switch (pid) {
-		default: {	/* parent */
-			Proc *proc = mkproc(pid, background);
-			if (proclist != NULL)
-				proclist->prev = proc;
-			proclist = proc;
+		default:	/* parent */
+			addproc(pid, background);
 			return pid;
-		}
 		case 0:		/* child */
-			while (proclist != NULL) {
-				Proc *p = proclist;
-				proclist = proclist->next;
-				efree(p);
-			}
+			while (livelist != NULL)
+				dropproc(livelist);
+			while (deadlist != NULL)
+				dropproc(deadlist);
 			hasforked = TRUE;
 #if JOB_PROTECT
 			tcpgid0 = 0;
@@ -62,6 +223,58 @@ extern int efork(Boolean parent, Boolean background) {
 	return 0;
 }
 
+#if HAVE_POSIX_SPAWN
+static void spawndup(void *actions, int old, int new) {
+	posix_spawn_file_actions_adddup2(actions, old, new);
+}
+
+static void spawnclose(void *actions, int fd) {
+	posix_spawn_file_actions_addclose(actions, fd);
+}
+
+/*
+ * espawn -- run a program in a new foreground process without forking
+ *	the shell, applying the same descriptor and signal changes as
+ *	efork() does in the child.  moves, if not NULL, is a list of
+ *	(from, to) descriptor pairs ended by -1, which are applied after
+ *	those changes.  returns the new pid, or 0 if the caller should
+ *	fork and exec instead, which is also how errors from the exec
+ *	are reported.
+ */
+extern int espawn(char *file, char **argv, char **envp, int *moves) {
+	pid_t pid;
+	int error;
+	sigset_t defaults;
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+
+	flushout();
+	if (posix_spawn_file_actions_init(&actions) != 0)
+		return 0;
+	if (!spawnfds(spawndup, spawnclose, &actions)) {
+		posix_spawn_file_actions_destroy(&actions);
+		return 0;
+	}
+	for (; moves != NULL && *moves != -1; moves += 2) {
+		spawndup(&actions, moves[0], moves[1]);
+		spawnclose(&actions, moves[0]);
+	}
+	posix_spawnattr_init(&attr);
+	getsigdefaults(&defaults);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+	error = posix_spawn(&pid, file, &actions, &attr, argv, envp);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if (error != 0)
+		return 0;
+	addproc(pid, FALSE);
+	return pid;
+}
+#endif
+
 extern pid_t spgrp(pid_t pgid) {
 	pid_t old = getpgrp();
 	setpgid(0, pgid);
@@ -111,82 +324,633 @@ extern void tcreturnpgrp(void) {
 }
 
 extern Noreturn esexit(int code) {
+	code = exitflush(code);
 	tcreturnpgrp();
 	exit(code);
 }
 #endif
 
-/* reap -- mark a process as dead and return it */
-static Proc *reap(int pid) {
-	Proc *proc;
-	for (proc = proclist; proc != NULL; proc = proc->next)
-		if (proc->pid == pid)
-			break;
-	assert(proc != NULL);
-	if (proc->next != NULL)
-		proc->next->prev = proc->prev;
-	if (proc->prev != NULL)
-		proc->prev->next = proc->next;
-	else
-		proclist = proc->next;
-	return proc;
-}
-
-/* ewait -- wait for a specific process to die, or any process if pid == -1 */
-extern int ewait(int pidarg, Boolean interruptible) {
-	int deadpid, status;
-	Proc *proc;
-	while ((deadpid = waitpid(pidarg, &status, 0)) == -1) {
-		if (errno == ECHILD && pidarg > 0)
-			fail("es:ewait", "wait: %d is not a child of this shell", pidarg);
+/*
+ * awaitproc -- wait until one of the n processes in pids has died,
+ *	or any child if n is 0, and return it.  deaths of other children
+ *	seen along the way are recorded for later.
+ */
+static Proc *awaitproc(int *pids, int n, Boolean interruptible) {
+	for (;;) {
+		int i, deadpid, status;
+		Usage usage;
+		if (n == 0) {
+			if (deadlist != NULL)
+				return deadlist;
+			if (livelist == NULL)
+				fail("es:ewait", "wait: %s", esstrerror(ECHILD));
+		} else
+			for (i = 0; i < n; i++) {
+				Proc *proc = findproc(pids[i]);
+				if (proc == NULL)
+					fail("es:ewait", "wait: %d is not a child of this shell", pids[i]);
+				if (!proc->alive)
+					return proc;
+			}
+		deadpid = waitchild(&status, 0, &usage);
+		if (deadpid != -1)
+			notedeath(deadpid, status, &usage);
 		else if (errno != EINTR)
 			fail("es:ewait", "wait: %s", esstrerror(errno));
-		if (interruptible)
+		else if (interruptible)
 			SIGCHK();
 	}
-	proc = reap(deadpid);
+}
+
+/* anydead -- has one of the n processes in pids died without being collected? */
+static Boolean anydead(int *pids, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		Proc *proc = findproc(pids[i]);
+		if (proc != NULL && !proc->alive)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* collect -- finish waiting for a dead process, and return its status */
+static int collect(Proc *proc) {
+	int status = proc->status;
 #if JOB_PROTECT
 	tctakepgrp();
 #endif
 	if (proc->background)
 		printstatus(proc->pid, status);
-	efree(proc);
+	addusage(&proc->usage);
+	dropproc(proc);
 	return status;
 }
 
+/* ewait -- wait for a specific process to die, or any process if pid == -1 */
+extern int ewait(int pid, Boolean interruptible) {
+	return collect(awaitproc(&pid, pid == -1 ? 0 : 1, interruptible));
+}
+
 #include "prim.h"
 
+/* $&apids -- the background jobs not yet waited for, in the order they were started */
 PRIM(apids) {
 	Proc *p;
 	Ref(List *, lp, NULL);
-	for (p = proclist; p != NULL; p = p->next)
-		if (p->background) {
-			Term *t = mkstr(str("%d", p->pid));
-			lp = mklist(t, lp);
-		}
-	/* TODO: sort the return value, but by number? */
+	for (p = bglast; p != NULL; p = p->bgprev) {
+		Term *t = mkstr(str("%d", p->pid));
+		lp = mklist(t, lp);
+	}
 	RefReturn(lp);
 }
 
+/* getwaitpid -- convert an argument of wait to a pid */
+static int getwaitpid(Term *term) {
+	int pid = atoi(getstr(term));
+	if (pid <= 0)
+		fail("$&wait", "wait: %d: bad pid", pid);
+	return pid;
+}
+
 PRIM(wait) {
-	int pid;
-	if (list == NULL)
-		pid = -1;
-	else if (list->next == NULL) {
-		pid = atoi(getstr(list->term));
-		if (pid <= 0) {
-			fail("$&wait", "wait: %d: bad pid", pid);
-			NOTREACHED;
+	int c, n;
+	Boolean any = FALSE;
+	static int *pids = NULL, pidmax = 0;
+
+	esoptbegin(list, "$&wait", "wait [-n] [pid ...]", TRUE);
+	while ((c = esopt("n")) != EOF)
+		switch (c) {
+		case 'n':	any = TRUE;	break;
 		}
-	} else {
-		fail("$&wait", "usage: wait [pid]");
-		NOTREACHED;
+	Ref(List *, result, NULL);
+	Ref(List *, lp, esoptend());
+	memzero(&jobusage, sizeof jobusage);
+
+	n = length(lp);
+	if (n > pidmax) {
+		pids = erealloc(pids, n * sizeof *pids);
+		pidmax = n;
 	}
-	return mklist(mkstr(mkstatus(ewait(pid, TRUE))), NULL);
+	for (n = 0; lp != NULL; lp = lp->next)
+		pids[n++] = getwaitpid(lp->term);
+	for (c = 0; c < n; c++)
+		if (findproc(pids[c]) == NULL)
+			fail("$&wait", "wait: %d is not a child of this shell", pids[c]);
+
+	if (any) {
+		/* wait for any one of the set, returning its status and pid */
+		Proc *proc = awaitproc(pids, n, TRUE);
+		int pid = proc->pid, status = collect(proc);
+		result = mklist(mkstr(str("%d", pid)), NULL);
+		result = mklist(mkstatusterm(status), result);
+	} else if (n == 0)
+		result = mklist(mkstatusterm(ewait(-1, TRUE)), NULL);
+	else
+		/* wait for all of the set, returning their statuses in order */
+		while (n > 0) {
+			Term *t = mkstatusterm(ewait(pids[--n], TRUE));
+			result = mklist(t, result);
+		}
+
+	RefEnd(lp);
+	RefReturn(result);
+}
+
+#if HAVE_WAIT4
+/* jobtimes -- the cpu time used by the last foreground job */
+extern void jobtimes(intmax_t *user_usec, intmax_t *sys_usec) {
+	*user_usec = jobusage.ru_utime.tv_sec * INTMAX_C(1000000)
+		   + jobusage.ru_utime.tv_usec;
+	*sys_usec = jobusage.ru_stime.tv_sec * INTMAX_C(1000000)
+		  + jobusage.ru_stime.tv_usec;
+}
+
+/*
+ * $&usage -- the resources used by the last foreground job:  user
+ *	and system time in seconds, peak resident set size in kilobytes,
+ *	major page faults, and voluntary and involuntary context switches
+ */
+PRIM(usage) {
+	int i;
+	char *fields[6];
+	Usage *u = &jobusage;
+
+	if (list != NULL)
+		fail("$&usage", "usage: $&usage");
+	gcdisable();
+	fields[0] = str("%ld.%06ld", (long) u->ru_utime.tv_sec, (long) u->ru_utime.tv_usec);
+	fields[1] = str("%ld.%06ld", (long) u->ru_stime.tv_sec, (long) u->ru_stime.tv_usec);
+	fields[2] = str("%ld", u->ru_maxrss);
+	fields[3] = str("%ld", u->ru_majflt);
+	fields[4] = str("%ld", u->ru_nvcsw);
+	fields[5] = str("%ld", u->ru_nivcsw);
+	Ref(List *, lp, NULL);
+	for (i = arraysize(fields); i > 0; i--) {
+		Term *t = mkstr(fields[i - 1]);
+		lp = mklist(t, lp);
+	}
+	gcenable();
+	RefReturn(lp);
+}
+#endif
+
+/* readjob -- read back the output a parallel job left in a scratch file */
+static char *readjob(int fd) {
+	long n;
+	char in[4096];
+	Buffer *buf = openbuffer(0);
+	lseek(fd, 0, SEEK_SET);
+	while ((n = read(fd, in, sizeof in)) != 0)
+		if (n > 0)
+			buf = bufncat(buf, in, n);
+		else if (errno != EINTR) {
+			freebuffer(buf);
+			fail("$&parallel", "read: %s", esstrerror(errno));
+		}
+	return sealcountedbuffer(buf);
+}
+
+/* ncpus -- the default number of parallel jobs */
+static int ncpus(void) {
+#if HAVE_SYSCONF && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > 0)
+		return n;
+#endif
+	return 1;
+}
+
+/*
+ * $&parallel -- run each argument as a command in a child, at most
+ *	slots at a time, and return their statuses in argument order.
+ *	with -o, each job's standard output is captured in a scratch
+ *	file and the outputs follow the statuses, one string per job.
+ */
+PRIM(parallel) {
+	int c, i, n;
+	volatile int slots = 0, running = 0, started = 0;
+	volatile Boolean capture = FALSE;
+	int *pids, *jobs, *fds, *statuses;
+	const char * const usage = "parallel [-o] [-j slots] cmd ...";
+
+	esoptbegin(list, "$&parallel", usage, TRUE);
+	while ((c = esopt("j:o")) != EOF)
+		switch (c) {
+		case 'j':
+			slots = atoi(getstr(esoptarg()));
+			if (slots <= 0)
+				fail("$&parallel", "-j: slot count must be positive");
+			break;
+		case 'o':
+			capture = TRUE;
+			break;
+		}
+	if (slots == 0)
+		slots = ncpus();
+
+	Ref(List *, result, NULL);
+	Ref(List *, lp, esoptend());
+	Ref(Vector *, outputs, NULL);
+	n = length(lp);
+	if (capture) {
+		outputs = mkvector(n);
+		outputs->count = n;
+	}
+	if (slots > n)
+		slots = n;
+
+	/* pids and jobs describe the running jobs; fds and statuses all */
+	pids = ealloc((slots + 1) * sizeof (int));
+	jobs = ealloc((slots + 1) * sizeof (int));
+	fds = ealloc((n + 1) * sizeof (int));
+	statuses = ealloc((n + 1) * sizeof (int));
+	for (i = 0; i < n; i++)
+		fds[i] = -1;
+
+	ExceptionHandler
+
+		for (;;) {
+			Proc *proc;
+			/* a dead job is collected before a new one can reuse its pid */
+			for (; running < slots && lp != NULL && !anydead(pids, running);
+			       lp = lp->next, started++) {
+				int pid;
+				if (capture && (fds[started] = anonfile("parallel")) == -1)
+					fail("$&parallel", "scratch file: %s", esstrerror(errno));
+				pid = efork(TRUE, FALSE);
+				if (pid == 0) {
+					running = 0;	/* the other jobs are not ours */
+					if (capture) {
+						releasefd(1);
+						mvfd(fds[started], 1);
+					}
+					esexit(exitstatus(eval1(lp->term, evalflags | eval_inchild)));
+				}
+				pids[running] = pid;
+				jobs[running++] = started;
+			}
+			if (running == 0)
+				break;
+
+			proc = awaitproc(pids, running, TRUE);
+			for (i = 0; pids[i] != proc->pid; i++)
+				;
+			c = jobs[i];
+			statuses[c] = collect(proc);
+			printstatus(0, statuses[c]);
+			--running;
+			pids[i] = pids[running];
+			jobs[i] = jobs[running];
+			if (capture) {
+				char *s = readjob(fds[c]);
+				outputs->vector[c] = s;
+				close(fds[c]);
+				fds[c] = -1;
+			}
+		}
+
+		if (capture)
+			for (i = n; i > 0; i--) {
+				Term *t = mkstr(outputs->vector[i - 1]);
+				result = mklist(t, result);
+			}
+		for (i = n; i > 0; i--) {
+			Term *t = mkstatusterm(statuses[i - 1]);
+			result = mklist(t, result);
+		}
+
+	CatchException (e)
+
+		/* nothing is left behind:  the jobs still running are killed and reaped */
+		for (i = 0; i < running; i++)
+			kill(pids[i], SIGKILL);
+		for (i = 0; i < running; i++)
+			ewaitfor(pids[i]);
+		for (i = 0; i < n; i++)
+			if (fds[i] != -1)
+				close(fds[i]);
+		efree(pids);
+		efree(jobs);
+		efree(fds);
+		efree(statuses);
+		throw(e);
+
+	EndExceptionHandler
+
+	for (i = 0; i < n; i++)
+		assert(fds[i] == -1);
+	efree(pids);
+	efree(jobs);
+	efree(fds);
+	efree(statuses);
+	RefEnd2(outputs, lp);
+	RefReturn(result);
+}
+
+/*
+ * $&pmap -- apply a function to each of a list of items in a pool of
+ *	forked workers.  the parent hands out item numbers one at a time
+ *	over a pipe to each worker, and each worker sends back the
+ *	result of the call, or the exception it raised, as a message:
+ *
+ *		int index, kind, count;  then count times:  int len; char str[len];
+ *
+ *	results are concatenated in item order.  the first exception, in
+ *	item order, is rethrown once all the workers are done.
+ */
+
+enum { pmapResult, pmapException };
+
+/* readfull -- read exactly n bytes, returning FALSE at end of file */
+static Boolean readfull(int fd, void *buf, size_t n) {
+	char *s = buf;
+	while (n > 0) {
+		long r = read(fd, s, n);
+		if (r == 0)
+			return FALSE;
+		if (r == -1) {
+			if (errno != EINTR)
+				fail("$&pmap", "read: %s", esstrerror(errno));
+			SIGCHK();
+			continue;
+		}
+		s += r;
+		n -= r;
+	}
+	return TRUE;
+}
+
+/* writefull -- write all of a buffer */
+static void writefull(int fd, const void *buf, size_t n) {
+	const char *s = buf;
+	/* the other end going away is an error, not a reason to exit */
+	Sigeffect pipeeffect = esignal(SIGPIPE, sig_ignore);
+	while (n > 0) {
+		long r = write(fd, s, n);
+		if (r == -1) {
+			int err = errno;
+			if (err == EINTR)
+				continue;
+			esignal(SIGPIPE, pipeeffect);
+			fail("$&pmap", "write: %s", esstrerror(err));
+		}
+		s += r;
+		n -= r;
+	}
+	esignal(SIGPIPE, pipeeffect);
+}
+
+/* pmapsend -- send the message for one item */
+static void pmapsend(int fd, int index, int kind, List *list) {
+	int hdr[3], len;
+	List *lp;
+	Buffer *buf = openbuffer(0);
+	hdr[0] = index;
+	hdr[1] = kind;
+	hdr[2] = length(list);
+	buf = bufncat(buf, (char *) hdr, sizeof hdr);
+	gcdisable();
+	for (lp = list; lp != NULL; lp = lp->next) {
+		char *str = getstr(lp->term);
+		len = strlen(str);
+		buf = bufncat(buf, (char *) &len, sizeof len);
+		buf = bufncat(buf, str, len);
+	}
+	gcenable();
+	writefull(fd, buf->str, buf->current);
+	freebuffer(buf);
+}
+
+/* pmapworker -- the body of a worker process */
+static Noreturn pmapworker(int in, int out, Term *fn0, List *items0) {
+	volatile int pos = 0;
+	int index;
+	Ref(Term *, fn, fn0);
+	Ref(List *, items, items0);
+	/* keep the pipes out of fn's redirections and its children */
+	registerfd(&in, TRUE);
+	registerfd(&out, TRUE);
+	/* the worker is a fresh child, so nothing may escape to the top level */
+	ExceptionHandler
+		while (readfull(in, &index, sizeof index) && index >= 0) {
+			List *volatile result = NULL;
+			volatile int kind = pmapResult;
+			for (; pos < index; pos++)
+				items = items->next;
+			ExceptionHandler
+				Ref(List *, call, mklist(items->term, NULL));
+				call = mklist(fn, call);
+				result = eval(call, NULL, 0);
+				RefEnd(call);
+			CatchException (e)
+				result = e;
+				kind = pmapException;
+			EndExceptionHandler
+			pmapsend(out, index, kind, result);
+		}
+	CatchException (e)
+		eprint("$&pmap: worker: %L\n", e, " ");
+		esexit(1);
+	EndExceptionHandler
+	RefEnd2(items, fn);
+	esexit(0);
+}
+
+/* pmapparse -- push the strings of a message onto a list, in reverse */
+static List *pmapparse(char *msg, List *list0) {
+	int i, count, len;
+	memcpy(&count, msg + 2 * sizeof (int), sizeof (int));
+	msg += 3 * sizeof (int);
+	Ref(List *, list, list0);
+	for (i = 0; i < count; i++) {
+		Term *t;
+		memcpy(&len, msg, sizeof len);
+		msg += sizeof len;
+		t = mkstr(gcndup(msg, len));
+		list = mklist(t, list);
+		msg += len;
+	}
+	RefReturn(list);
+}
+
+/* pmapreceive -- read one message, returning its item index */
+static int pmapreceive(int fd, char **msgs) {
+	int hdr[3], i, len;
+	Buffer *buf;
+	if (!readfull(fd, hdr, sizeof hdr))
+		fail("$&pmap", "worker exited unexpectedly");
+	buf = openbuffer(0);
+	buf = bufncat(buf, (char *) hdr, sizeof hdr);
+	for (i = 0; i < hdr[2]; i++) {
+		if (!readfull(fd, &len, sizeof len))
+			goto eof;
+		buf = bufncat(buf, (char *) &len, sizeof len);
+		if (buf->current + len > buf->len)
+			buf = expandbuffer(buf, len);
+		if (!readfull(fd, buf->str + buf->current, len))
+			goto eof;
+		buf->current += len;
+	}
+	msgs[hdr[0]] = ealloc(buf->current);
+	memcpy(msgs[hdr[0]], buf->str, buf->current);
+	freebuffer(buf);
+	return hdr[0];
+eof:
+	freebuffer(buf);
+	fail("$&pmap", "worker exited unexpectedly");
+}
+
+PRIM(pmap) {
+	int c, i, n;
+	volatile int slots = 0;
+	volatile int next = 0;
+	int *pids, *to, *from, *busy;
+	char **msgs;
+	struct pollfd *pfds;
+
+	esoptbegin(list, "$&pmap", "pmap [-j slots] fn item ...", TRUE);
+	while ((c = esopt("j:")) != EOF)
+		switch (c) {
+		case 'j':
+			slots = atoi(getstr(esoptarg()));
+			if (slots <= 0)
+				fail("$&pmap", "-j: slot count must be positive");
+			break;
+		}
+	if (slots == 0)
+		slots = ncpus();
+
+	Ref(List *, result, NULL);
+	Ref(List *, lp, esoptend());
+	if (lp == NULL)
+		fail("$&pmap", "usage: pmap [-j slots] fn item ...");
+	Ref(Term *, fn, lp->term);
+	lp = lp->next;
+	n = length(lp);
+	if (slots > n)
+		slots = n;
+
+	pids = ealloc((slots + 1) * sizeof (int));
+	to = ealloc((slots + 1) * sizeof (int));
+	from = ealloc((slots + 1) * sizeof (int));
+	busy = ealloc((slots + 1) * sizeof (int));
+	pfds = ealloc((slots + 1) * sizeof (struct pollfd));
+	msgs = ealloc((n + 1) * sizeof (char *));
+	for (i = 0; i < n; i++)
+		msgs[i] = NULL;
+	for (i = 0; i < slots; i++)
+		pids[i] = to[i] = from[i] = -1;
+
+	ExceptionHandler
+
+		int w, done = 0;
+		for (w = 0; w < slots; w++) {
+			int down[2], up[2];
+			if (cloexecpipe(down) == -1)
+				fail("$&pmap", "pipe: %s", esstrerror(errno));
+			if (cloexecpipe(up) == -1) {
+				close(down[0]);
+				close(down[1]);
+				fail("$&pmap", "pipe: %s", esstrerror(errno));
+			}
+			to[w] = down[1];
+			from[w] = up[0];
+			registerfd(&to[w], TRUE);	/* so no worker keeps another's */
+			registerfd(&from[w], TRUE);
+			if ((pids[w] = efork(TRUE, FALSE)) == 0)
+				pmapworker(down[0], up[1], fn, lp);
+			close(down[0]);
+			close(up[1]);
+			pfds[w].fd = from[w];
+			pfds[w].events = POLLIN;
+		}
+
+		for (w = 0; w < slots; w++) {
+			busy[w] = next++;
+			writefull(to[w], &busy[w], sizeof busy[w]);
+		}
+		while (done < n) {
+			if (poll(pfds, slots, -1) == -1) {
+				if (errno != EINTR)
+					fail("$&pmap", "poll: %s", esstrerror(errno));
+				SIGCHK();
+				continue;
+			}
+			for (w = 0; w < slots; w++)
+				if (pfds[w].revents != 0) {
+					pmapreceive(from[w], msgs);
+					done++;
+					busy[w] = next < n ? next++ : -1;
+					writefull(to[w], &busy[w], sizeof busy[w]);
+					if (busy[w] == -1)	/* ignore its hangup */
+						pfds[w].fd = -1;
+				}
+		}
+
+	CatchException (e)
+
+		for (i = 0; i < slots; i++) {
+			if (to[i] != -1) {
+				unregisterfd(&to[i]);
+				close(to[i]);
+			}
+			if (from[i] != -1) {
+				unregisterfd(&from[i]);
+				close(from[i]);
+			}
+		}
+		/* as in $&parallel, the workers are stopped rather than waited out */
+		for (i = 0; i < slots; i++)
+			if (pids[i] > 0)
+				kill(pids[i], SIGTERM);
+		for (i = 0; i < slots; i++)
+			if (pids[i] > 0)
+				ewait(pids[i], FALSE);
+		for (i = 0; i < n; i++)
+			if (msgs[i] != NULL)
+				efree(msgs[i]);
+		efree(pids); efree(to); efree(from); efree(busy); efree(pfds); efree(msgs);
+		throw(e);
+
+	EndExceptionHandler
+
+	for (i = 0; i < slots; i++) {
+		unregisterfd(&to[i]);
+		unregisterfd(&from[i]);
+		close(to[i]);
+		close(from[i]);
+		ewait(pids[i], FALSE);
+	}
+	efree(pids); efree(to); efree(from); efree(busy); efree(pfds);
+
+	/* gather the results in order, stopping at the first exception */
+	for (i = 0; i < n; i++) {
+		int kind;
+		memcpy(&kind, msgs[i] + sizeof (int), sizeof kind);
+		if (kind == pmapException) {
+			lp = reverse(pmapparse(msgs[i], NULL));
+			break;
+		}
+		result = pmapparse(msgs[i], result);
+	}
+	for (c = 0; c < n; c++)
+		efree(msgs[c]);
+	efree(msgs);
+	if (i < n)
+		throw(lp);
+
+	RefEnd2(fn, lp);
+	result = reverse(result);
+	RefReturn(result);
 }
 
 extern Dict *initprims_proc(Dict *primdict) {
 	X(apids);
 	X(wait);
+	X(parallel);
+	X(pmap);
+#if HAVE_WAIT4
+	X(usage);
+#endif
 	return primdict;
 }
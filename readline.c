@@ -74,6 +74,9 @@ static int count_history(void) {
 }
 
 static void reload_history(void) {
+	const char *phase = NULL;
+	if (startuptimes != NULL)
+		phase = startphase("history");
 	/* Attempt to populate readline history with new history file. */
 	if (history != NULL) {
 		int n = count_history() - sethistorylength;
@@ -83,6 +86,8 @@ static void reload_history(void) {
 	using_history();
 
 	reloadhistory = FALSE;
+	if (phase != NULL)
+		startphase(phase);
 }
 
 static void inithistory(void) {
@@ -426,6 +431,7 @@ PRIM(readline) {
 		return mklist(mkstr(str("%L", list, "")), NULL);
 	}
 
+	flushout();
 	rl_instream = fdmapopen(0, "r");
 	ExceptionHandler
 		rl_outstream = fdmapopen(2, "w");
@@ -0,0 +1,400 @@
+/* server.c -- persistent server and thin client modes ($Revision: 1.1 $) */
+
+#define	_GNU_SOURCE	1	/* for ppoll() */
+#define	REQUIRE_STAT	1
+#define	REQUIRE_FCNTL	1
+
+#include "es.h"
+#include "gc.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+/*
+ * a server (es -S socket) initializes once and then accepts requests on
+ * a unix-domain socket.  a client (es -C socket ...) connects and sends
+ *
+ *	a header:	uint32 argc, envc, umask, ignored, length
+ *	with its standard input, output and error attached (SCM_RIGHTS),
+ *	then length bytes of nul-terminated strings:  cwd, argv, environ.
+ *
+ * the server forks a child for each request, which adopts the client's
+ * descriptors, environment, working directory and ignored signals (a
+ * bit for each of the passed signals below) and carries on as a
+ * newly started shell with the client's arguments.  the server replies
+ * with the child's pid, so the client can forward signals to it, and
+ * later with its wait status.  the server, not the child, sends the
+ * status, so it is still reported if the child execs or is killed.
+ */
+
+typedef uint32_t Word;
+
+enum { hArgc, hEnvc, hUmask, hIgnored, hLength, hSize };
+
+/* the signals a client passes on to its request */
+static const int passed[] = { SIGHUP, SIGINT, SIGQUIT, SIGTERM };
+
+#define	NREQFDS	3
+
+/* xread -- read exactly n bytes, returning FALSE on end of file or error */
+static Boolean xread(int fd, void *buf, size_t n) {
+	char *s = buf;
+	while (n > 0) {
+		long r = read(fd, s, n);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return FALSE;
+		s += r;
+		n -= r;
+	}
+	return TRUE;
+}
+
+/* xwrite -- write all of a buffer, returning FALSE on error */
+static Boolean xwrite(int fd, const void *buf, size_t n) {
+	const char *s = buf;
+	while (n > 0) {
+		long r = write(fd, s, n);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r == -1)
+			return FALSE;
+		s += r;
+		n -= r;
+	}
+	return TRUE;
+}
+
+/* sockaddr -- fill in the address of a named socket */
+static socklen_t sockaddr(struct sockaddr_un *addr, const char *path) {
+	if (strlen(path) >= sizeof addr->sun_path)
+		fail("es:server", "%s: socket name too long", path);
+	memzero(addr, sizeof (struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return sizeof (struct sockaddr_un);
+}
+
+
+/*
+ * the server
+ */
+
+typedef struct {
+	int pid, conn;
+} Session;
+
+static Session *sessions = NULL;
+static int nsessions = 0, maxsessions = 0;
+
+static void sigchld(int UNUSED sig) {
+}
+
+/* finish -- report the status of dead children to their clients */
+static void finish(void) {
+	int pid, status, i;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		for (i = 0; i < nsessions; i++)
+			if (sessions[i].pid == pid) {
+				Word w = status;
+				xwrite(sessions[i].conn, &w, sizeof w);
+				close(sessions[i].conn);
+				sessions[i] = sessions[--nsessions];
+				break;
+			}
+}
+
+/* adopt -- take over a client's request, in a newly forked child */
+static char **adopt(int conn, int *argcp) {
+	int i, n, *fds;
+	Word hdr[hSize];
+	char *data, *s, **argv;
+	struct iovec iov;
+	struct msghdr msg;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(NREQFDS * sizeof (int))];
+	} control;
+	struct cmsghdr *cmsg;
+
+	memzero(&msg, sizeof msg);
+	iov.iov_base = hdr;
+	iov.iov_len = sizeof hdr;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+	do
+		n = recvmsg(conn, &msg, 0);
+	while (n == -1 && errno == EINTR);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (
+		n <= 0
+	     || cmsg == NULL
+	     || cmsg->cmsg_level != SOL_SOCKET
+	     || cmsg->cmsg_type != SCM_RIGHTS
+	     || cmsg->cmsg_len != CMSG_LEN(NREQFDS * sizeof (int))
+	     || (n < (int) sizeof hdr && !xread(conn, (char *) hdr + n, sizeof hdr - n))
+	     || hdr[hArgc] == 0
+	)
+		exit(1);
+
+	data = ealloc(hdr[hLength] + 1);
+	if (!xread(conn, data, hdr[hLength]))
+		exit(1);
+	data[hdr[hLength]] = '\0';
+	close(conn);
+
+	fds = (int *) CMSG_DATA(cmsg);
+	for (i = 0; i < NREQFDS; i++) {
+		dup2(fds[i], i);
+		if (fds[i] >= NREQFDS)
+			close(fds[i]);
+	}
+
+	s = data;
+	if (chdir(s) == -1)
+		eprint("es: %s: %s\n", s, esstrerror(errno));
+	umask(hdr[hUmask]);
+	for (i = 0; i < (int) arraysize(passed); i++)
+		signal(passed[i], (hdr[hIgnored] & (1 << i)) ? SIG_IGN : SIG_DFL);
+	argv = ealloc((hdr[hArgc] + 1) * sizeof (char *));
+	for (i = 0; i < (int) hdr[hArgc]; i++) {
+		s += strlen(s) + 1;
+		argv[i] = s;
+	}
+	argv[i] = NULL;
+	environ = ealloc((hdr[hEnvc] + 1) * sizeof (char *));
+	for (i = 0; i < (int) hdr[hEnvc]; i++) {
+		s += strlen(s) + 1;
+		environ[i] = s;
+	}
+	environ[i] = NULL;
+
+	*argcp = hdr[hArgc];
+	return argv;
+}
+
+/*
+ * trusted -- is the client on a connection run by our own user?  the
+ *	socket is created mode 0600, and where the system can say who is
+ *	at the other end, that is checked too.
+ */
+static Boolean trusted(int UNUSED conn) {
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof cred;
+	if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		return FALSE;
+	return cred.uid == geteuid();
+#else
+	return TRUE;
+#endif
+}
+
+/*
+ * serve -- listen on a socket and fork a child per request.  only
+ *	returns in a child, with the argument vector of the request.
+ */
+extern char **serve(const char *path, int *argcp) {
+	int sock, conn, pid, i;
+	mode_t mask;
+	struct sockaddr_un addr;
+	struct sigaction sa, pipesa;
+	struct pollfd pfd;
+	sigset_t chld, old;
+	socklen_t len = sockaddr(&addr, str("%s.%d", path, getpid()));
+#if !HAVE_PPOLL
+	int n;
+#endif
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		fail("es:server", "socket: %s", esstrerror(errno));
+	/* bound under a temporary name, so the socket appears already listening */
+	unlink(addr.sun_path);
+	mask = umask(077);	/* only our own user may connect */
+	if (bind(sock, (struct sockaddr *) &addr, len) == -1) {
+		umask(mask);
+		fail("es:server", "%s: %s", path, esstrerror(errno));
+	}
+	umask(mask);
+	if (chmod(addr.sun_path, 0600) == -1 || listen(sock, 64) == -1 ||
+	    rename(addr.sun_path, path) == -1) {
+		unlink(addr.sun_path);
+		fail("es:server", "%s: %s", path, esstrerror(errno));
+	}
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+	/* children are reaped when SIGCHLD interrupts the wait for clients */
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old);
+	memzero(&sa, sizeof sa);
+	sa.sa_handler = sigchld;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	/* a client that has gone away must not take the server with it */
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, &pipesa);
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		finish();
+#if HAVE_PPOLL
+		if (ppoll(&pfd, 1, NULL, &old) == -1)
+			continue;
+#else
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		n = poll(&pfd, 1, 100);
+		sigprocmask(SIG_BLOCK, &chld, NULL);
+		if (n <= 0)
+			continue;
+#endif
+		if ((conn = accept(sock, NULL, NULL)) == -1)
+			continue;
+		if (!trusted(conn)) {
+			close(conn);
+			continue;
+		}
+
+		if (nsessions >= maxsessions) {
+			maxsessions += 16;
+			sessions = erealloc(sessions, maxsessions * sizeof (Session));
+		}
+
+		switch (pid = fork()) {
+		case 0:
+			close(sock);
+			for (i = 0; i < nsessions; i++)
+				close(sessions[i].conn);
+			nsessions = 0;
+			sigaction(SIGPIPE, &pipesa, NULL);
+			sa.sa_handler = SIG_DFL;
+			sigaction(SIGCHLD, &sa, NULL);
+			sigprocmask(SIG_SETMASK, &old, NULL);
+			efork(FALSE, FALSE);
+			return adopt(conn, argcp);
+		case -1:
+			eprint("es: fork: %s\n", esstrerror(errno));
+			close(conn);
+			break;
+		default: {
+			Word w = pid;
+			if (xwrite(conn, &w, sizeof w)) {
+				sessions[nsessions].pid = pid;
+				sessions[nsessions].conn = conn;
+				nsessions++;
+			} else
+				close(conn);
+			break;
+		}
+		}
+	}
+}
+
+
+/*
+ * the client
+ */
+
+static volatile int serverchild = 0;
+
+static void passsignal(int sig) {
+	if (serverchild > 0)
+		kill(serverchild, sig);
+}
+
+/*
+ * client -- pass a request to a server.  returns if there is no server
+ *	on the socket; otherwise, exits as the request did.
+ */
+extern void client(const char *path, int argc, char **argv) {
+	int i, sock, fds[NREQFDS];
+	mode_t mask;
+	Word hdr[hSize], w;
+	char cwd[4096], **envp;
+	Buffer *buf;
+	struct sockaddr_un addr;
+	struct iovec iov;
+	struct msghdr msg;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(NREQFDS * sizeof (int))];
+	} control;
+	struct cmsghdr *cmsg;
+
+	if (strlen(path) >= sizeof addr.sun_path)
+		return;
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return;
+	if (connect(sock, (struct sockaddr *) &addr, sockaddr(&addr, path)) == -1) {
+		close(sock);
+		return;
+	}
+
+	if (getcwd(cwd, sizeof cwd) == NULL)
+		strcpy(cwd, "/");
+	buf = openbuffer(0);
+	buf = bufncat(buf, cwd, strlen(cwd) + 1);
+	for (i = 0; i < argc; i++)
+		buf = bufncat(buf, argv[i], strlen(argv[i]) + 1);
+	for (envp = environ; *envp != NULL; envp++)
+		buf = bufncat(buf, *envp, strlen(*envp) + 1);
+	mask = umask(0);
+	umask(mask);
+	hdr[hArgc] = argc;
+	hdr[hEnvc] = envp - environ;
+	hdr[hUmask] = mask;
+	hdr[hIgnored] = 0;
+	for (i = 0; i < (int) arraysize(passed); i++) {
+		struct sigaction sa;
+		if (sigaction(passed[i], NULL, &sa) == 0 && sa.sa_handler == SIG_IGN)
+			hdr[hIgnored] |= 1 << i;
+	}
+	hdr[hLength] = buf->current;
+
+	memzero(&msg, sizeof msg);
+	iov.iov_base = hdr;
+	iov.iov_len = sizeof hdr;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(NREQFDS * sizeof (int));
+	for (i = 0; i < NREQFDS; i++)
+		fds[i] = i;
+	memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+	for (i = 0; i < (int) arraysize(passed); i++)
+		if (!(hdr[hIgnored] & (1 << i)))
+			signal(passed[i], passsignal);
+	if (
+		sendmsg(sock, &msg, 0) != (long) sizeof hdr
+	     || !xwrite(sock, buf->str, buf->current)
+	     || !xread(sock, &w, sizeof w)
+	) {
+		eprint("es: %s: request failed\n", path);
+		exit(1);
+	}
+	freebuffer(buf);
+	serverchild = w;
+	if (!xread(sock, &w, sizeof w)) {
+		eprint("es: %s: lost connection to server\n", path);
+		exit(1);
+	}
+	if (WIFSIGNALED(w)) {
+		signal(WTERMSIG(w), SIG_DFL);
+		kill(getpid(), WTERMSIG(w));
+	}
+	exit(WIFEXITED(w) ? WEXITSTATUS(w) : 1);
+}
@@ -2,6 +2,7 @@
 
 #include "es.h"
 #include "sigmsgs.h"
+#include "term.h"
 
 typedef void (*Sighandler)(int);
 
@@ -12,6 +13,8 @@ static Atomic caught[NSIG];
 static Sigeffect sigeffect[NSIG];
 static Sighandler handler_in[NSIG];
 
+static const Term signalterm = { "signal", NULL };
+
 /*
  * these variables are for the purpose of forcing a "return" from library or
  * system calls when a signal is received, since some of them don't do that
@@ -59,6 +62,22 @@ extern char *signame(int sig) {
 	return str("sig%d", sig);
 }
 
+/* sigterm -- a term naming a signal;  terms for known signals are shared */
+extern Term *sigterm(int sig) {
+	static Term terms[NSIG];
+	int i;
+	if (0 < sig && sig < NSIG) {
+		if (terms[sig].str != NULL)
+			return &terms[sig];
+		for (i = 0; i < nsignals; i++)
+			if (signals[i].sig == sig) {
+				terms[sig].str = (char *) signals[i].name;
+				return &terms[sig];
+			}
+	}
+	return mkstr(signame(sig));
+}
+
 extern char *sigmessage(int sig) {
 	int i;
 	for (i = 0; i < nsignals; i++)
@@ -93,6 +112,32 @@ static void catcher(int sig) {
  * setting and getting signal effects
  */
 
+static Sighandler setsignal(int sig, Sighandler handler);
+
+/*
+ * flushdie -- stand in for SIG_DFL on the signals that usually just end
+ *	the shell, so that output print() has buffered is not lost with it.
+ */
+static void flushdie(int sig) {
+	if (!sigflush(sig))
+		return;		/* print() raises it again when it is done */
+	setsignal(sig, SIG_DFL);
+	kill(getpid(), sig);	/* delivered as soon as the handler returns */
+}
+
+/* defaulthandler -- the kernel handler for a signal left at its default */
+static Sighandler defaulthandler(int sig) {
+	if (handler_in[sig] != NULL && handler_in[sig] != SIG_DFL)
+		return handler_in[sig];
+	switch (sig) {
+	    case SIGHUP: case SIGINT: case SIGQUIT: case SIGTERM: case SIGALRM:
+	    case SIGUSR1: case SIGUSR2:
+		return flushdie;
+	    default:
+		return SIG_DFL;
+	}
+}
+
 static Sighandler setsignal(int sig, Sighandler handler) {
 #if HAVE_SIGACTION
 	struct sigaction nsa, osa;
@@ -137,7 +182,7 @@ extern Sigeffect esignal(int sig, Sigeffect effect) {
 			}
 			break;
 		case sig_default:
-			setsignal(sig, (handler_in[sig] == NULL ? SIG_DFL : handler_in[sig]));
+			setsignal(sig, defaulthandler(sig));
 			break;
 		default:
 			NOTREACHED;
@@ -192,6 +237,8 @@ extern void initsignals(Boolean interactive, Boolean allowdumps) {
 			sigeffect[sig] = sig_default;
 			if (h != SIG_ERR)
 				handler_in[sig] = h;
+			if (defaulthandler(sig) != h)
+				setsignal(sig, defaulthandler(sig));
 		}
 	}
 
@@ -219,6 +266,17 @@ extern void setsigdefaults(void) {
 	}
 }
 
+/* getsigdefaults -- the set of signals which setsigdefaults() resets */
+extern void getsigdefaults(sigset_t *set) {
+	int sig;
+	sigemptyset(set);
+	for (sig = 1; sig < NSIG; sig++) {
+		Sigeffect e = sigeffect[sig];
+		if (e == sig_catch || e == sig_noop || e == sig_special)
+			sigaddset(set, sig);
+	}
+}
+
 
 /*
  * utility functions
@@ -239,7 +297,8 @@ extern void exitonsignal(List *exception) {
 	if (sig == -1)
 		return;
 
-	/* try to die via this signal */
+	/* try to die via this signal, keeping what was already printed */
+	quietflush();
 	e = esignal(sig, sig_default);
 	kill(getpid(), sig);
 
@@ -314,7 +373,7 @@ extern void sigchk(void) {
 	}
 	Ref(List *, e, NULL);
 	gcdisable();
-	e = mklist(mkstr("signal"), mklist(mkstr(signame(sig)), NULL));
+	e = mklist((Term *) &signalterm, mklist(sigterm(sig), NULL));
 	gcenable();
 
 	switch (sigeffect[sig]) {
@@ -104,6 +104,38 @@ extern List *endsplit(void) {
 	return result;
 }
 
+/*
+ * splitall -- split a whole string held outside the gc heap, such as a
+ *	mapped file, copying each word once rather than a byte at a time
+ *	through a buffer.
+ */
+extern List *splitall(const char *sep, const char *in, size_t len, Boolean coalescef) {
+	const unsigned char *s = (const unsigned char *) in, *end = s + len;
+
+	startsplit(sep, coalescef);
+	if (splitchars) {
+		for (; s < end; s++)
+			if (*s != '\0') {
+				Term *term = mkstr(gcndup((const char *) s, 1));
+				value = mklist(term, value);
+			}
+		return endsplit();
+	}
+	for (;;) {
+		const unsigned char *word = s;
+		while (s < end && !isifs[*s])
+			s++;
+		if (s > word || !coalesce) {
+			Term *term = mkstr(gcndup((const char *) word, s - word));
+			value = mklist(term, value);
+		}
+		if (s == end)
+			break;
+		s++;
+	}
+	return endsplit();
+}
+
 extern List *fsplit(const char *sep, List *list, Boolean coalesce) {
 	Ref(List *, lp, list);
 	startsplit(sep, coalesce);
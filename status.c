@@ -63,6 +63,31 @@ extern char *mkstatus(int status) {
 	return str("%d", WEXITSTATUS(status));
 }
 
+/* mkstatusterm -- turn a unix exit(2) status into a term;  common ones are shared */
+extern Term *mkstatusterm(int status) {
+	static Term exitterms[256];
+	static char exitnames[256][4];
+	int n;
+
+	if (WIFSIGNALED(status))
+		return WCOREDUMP(status)
+			? mkstr(mkstatus(status))
+			: sigterm(WTERMSIG(status));
+
+	n = WEXITSTATUS(status);
+	if (exitterms[n].str == NULL) {
+		char *s = exitnames[n];
+		if (n >= 100)
+			*s++ = '0' + n / 100;
+		if (n >= 10)
+			*s++ = '0' + n / 10 % 10;
+		*s++ = '0' + n % 10;
+		*s = '\0';
+		exitterms[n].str = exitnames[n];
+	}
+	return &exitterms[n];
+}
+
 /* printstatus -- print the status if we should */
 extern void printstatus(int pid, int status) {
 	if (WIFSIGNALED(status)) {
@@ -62,6 +62,10 @@
 #include <sys/stat.h>
 #endif
 
+#if REQUIRE_SPAWN && HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
+
 #if REQUIRE_DIRENT
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -86,6 +90,10 @@ extern Dirent *readdir(DIR *);
 #include <fcntl.h>
 #endif
 
+#if REQUIRE_MMAN
+#include <sys/mman.h>
+#endif
+
 /* stdlib */
 #ifndef Noreturn
 #if __GNUC__
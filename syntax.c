@@ -70,6 +70,38 @@ extern Tree *backquote(Tree *ifs, Tree *body) {
 				  treecons(body, NULL))));
 }
 
+/* isliteral -- true iff a word can be joined to another without changing its meaning */
+static Boolean isliteral(Tree *t, Boolean first) {
+	const char *s;
+	if (t->kind == nQword)
+		return TRUE;
+	if (t->kind != nWord)
+		return FALSE;
+	s = t->u[0].s;
+	if (first && *s == '~')
+		return FALSE;
+	return strpbrk(s, "*?[") == NULL;
+}
+
+/* mkconcat -- create a concatenation, folding it if both sides are literal words */
+extern Tree *mkconcat(Tree *t1, Tree *t2) {
+	if (t1->kind == nWord && t2->kind == nWord)
+		return mk(nWord, pstr("%s%s", t1->u[0].s, t2->u[0].s));
+	if (isliteral(t1, TRUE) && isliteral(t2, FALSE))
+		return mk(nQword, pstr("%s%s", t1->u[0].s, t2->u[0].s));
+	return mk(nConcat, t1, t2);
+}
+
+/* mkname -- share the string of a word used as a name, as the atom for it */
+extern Tree *mkname(Tree *t) {
+	if (t != NULL && (t->kind == nWord || t->kind == nQword)) {
+		char *s = atom(t->u[0].s);
+		if (s != NULL)
+			t->u[0].s = s;
+	}
+	return t;
+}
+
 /* fnassign -- translate a function definition into an assignment */
 extern Tree *fnassign(Tree *name, Tree *defn) {
 	return mk(nAssign, mk(nConcat, mk(nWord, "fn-"), name), defn);
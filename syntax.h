@@ -22,6 +22,8 @@ extern Tree *thunkify(Tree *tree);
 extern Tree *prefix(char *s, Tree *t);
 extern Tree *backquote(Tree *ifs, Tree *body);
 extern Tree *flatten(Tree *t, char *sep);
+extern Tree *mkconcat(Tree *t1, Tree *t2);
+extern Tree *mkname(Tree *t);
 extern Tree *fnassign(Tree *name, Tree *defn);
 extern Tree *mklambda(Tree *params, Tree *body);
 extern Tree *mkseq(char *op, Tree *t1, Tree *t2);
@@ -25,15 +25,18 @@ extern Term *mkstr(char *str) {
         return term;
 }
 
+/* iscodestring -- would getclosure() turn a term with this string into a closure? */
+extern Boolean iscodestring(const char *s) {
+	return ((*s == '{' || *s == '@') && s[strlen(s) - 1] == '}')
+		|| (*s == '$' && s[1] == '&')
+		|| hasprefix(s, "%closure");
+}
+
 extern Closure *getclosure(Term *term) {
 	if (term->closure == NULL) {
 		char *s = term->str;
 		assert(s != NULL);
-		if (
-			((*s == '{' || *s == '@') && s[strlen(s) - 1] == '}')
-			|| (*s == '$' && s[1] == '&')
-			|| hasprefix(s, "%closure")
-		) {
+		if (iscodestring(s)) {
 			Closure *c;
 			Ref(Term *, tp, term);
 			Ref(Tree *, np, parsestring(s));
@@ -102,7 +105,7 @@ extern Boolean termeq(Term *term, const char *s) {
 	assert(term != NULL);
 	if (term->str == NULL)
 		return FALSE;
-	return streq(term->str, s);
+	return term->str == s || streq(term->str, s);
 }
 
 extern Boolean isclosure(Term *term) {
@@ -0,0 +1,52 @@
+# tests/cache.es -- verify that cached parses and dumped images behave like a fresh start
+
+test 'parse cache' {
+	let (dir = /tmp/es-cache-$pid; script = /tmp/es-cached-$pid.es) {
+		mkdir $dir
+		echo 'fn f x {echo f $x}
+f <={%count a b}
+echo `{echo done} <<< ignored' > $script
+		local (parsecache = $dir) {
+			assert {~ `{$es $script} (f 2 done)} 'first run'
+			assert {let (c = `{ls $dir}) ~ $#c 1} 'a cache is written'
+			assert {~ `{$es $script} (f 2 done)} 'cached run'
+			let (c = $dir/*) {
+				sed 's/done/DONE/' < $c > $c.new
+				mv $c.new $c
+			}
+			assert {~ `{$es $script} (f 2 DONE)} 'the cache is replayed'
+			echo 'echo more' >> $script
+			assert {~ `{$es $script} (f 2 done more)} 'a changed script is parsed again'
+			assert {~ `{$es -n $script} ()} '-n bypasses the cache'
+			echo 'echo {' > $script.bad
+			$es $script.bad >[2] /dev/null
+			assert {let (c = `{ls $dir}) ~ $#c 1} 'syntax errors are not cached'
+			rm -f $dir/*
+			mkdir $script.d $script.d/a
+			echo 'echo one' > $script.d/a%b
+			echo 'echo two' > $script.d/a/b
+			{$es $script.d/a%b; $es $script.d/a/b} > /dev/null
+			assert {~ `{$es $script.d/a%b} one && ~ `{$es $script.d/a/b} two}
+			assert {let (c = `{ls $dir}) ~ $#c 2} 'similar paths have their own caches'
+		}
+		rm -rf $dir $script $script.bad $script.d
+	}
+}
+
+test 'images' {
+	let (image = /tmp/es-image-$pid; script = /tmp/es-imaged-$pid.es) {
+		echo 'fn greet name {echo hello $name}
+let (n = 0) fn bump {n = $n x; echo $#n}
+code = ''{echo from a string}''
+pid = 0' > $script
+		$es -c '. '^$script^'; %dumpimage '^$image
+		assert {~ `{$es -m $image -c 'greet you'} (hello you)} 'functions are loaded'
+		assert {~ `{$es -m $image -c 'bump; $&collect; bump'} (1 2)} 'lexical bindings can be assigned'
+		assert {~ `{$es -m $image -c '$code; $&collect; $code'} (from a string from a string)} 'code strings become closures'
+		assert {!~ `{$es -m $image -c 'echo $pid'} 0} '$pid is not saved'
+		assert {~ `{local (code = env) $es -m $image -c 'echo $code'} env} 'the environment overrides the image'
+		echo garbage > $image
+		assert {~ `{$es -m $image -c 'echo ok' >[2] /dev/null} ok} 'a bad image is ignored'
+		rm -f $image $script
+	}
+}
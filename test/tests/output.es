@@ -0,0 +1,21 @@
+# tests/output.es -- verify that buffered output is written in order and in time
+
+test 'output buffering' {
+	assert {~ `{$es -c 'echo a; echo b >[1=2]; /bin/echo c; echo d' >[2=1]} (a b c d)} 'output keeps its order across fds and children'
+	assert {~ `{$es -c 'echo -n a; exec /bin/echo b'} ab} 'output is written before exec'
+	assert {~ `{$es -c 'echo a; exit 3'} a} 'output is written at exit'
+	assert {~ `{$es -c 'echo -n a; %flush; echo b'} ab}
+	assert {!$es -c 'echo x > /dev/full' >[2] /dev/null} 'write errors are reported'
+	assert {!$es -c 'echo x' > /dev/full >[2] /dev/null} 'write errors at exit fail the shell'
+	assert {~ `` '' {$es -c 'echo x' >[2=1] > /dev/full} 'print: '*} 'and are reported'
+	let (out = /tmp/es-killed-$pid; fifo = /tmp/es-killed-$pid.fifo) {
+		# the fifo is read without a flush, so the echo has run once it is written
+		mkfifo $fifo
+		$es -c 'echo started; %readfile '^$fifo^'; while {true} {}' > $out &
+		timeout 10 sh -c 'echo go > '^$fifo
+		kill $apid
+		wait $apid >[2] /dev/null
+		assert {~ `{cat $out} started} 'output is written when a signal ends the shell'
+		rm -f $out $fifo
+	}
+}
@@ -0,0 +1,53 @@
+# tests/pipe.es -- verify pipelines, lastpipe and coprocesses
+
+test 'pipeline stages' {
+	assert {~ `` \n {echo c a b | tr ' ' \n | sort | tr -d \n} abc}
+	assert {~ <={%flatten ' ' <={/bin/true | /bin/false | /bin/true}} '0 1 0'} 'each stage reports its own status'
+	local (fn tr {echo wrapped}) {
+		assert {~ `{echo a | tr a b} wrapped} 'functions win over programs in a stage'
+	}
+	assert {~ `{echo a | {ls /dev/fd/ | wc -l}} `{ls /dev/fd/ | wc -l}} 'stages leak no pipe descriptors'
+	assert {~ `{echo x |[1=3] cat /dev/fd/3 |[1] cat} x} 'pipes can join any descriptors'
+	let (old = $fn-%pathsearch; counter = ())
+	local (fn %pathsearch name {counter = $counter x; $old $name}) {
+		true | cat
+		assert {~ $#counter 0} 'a redefined %pathsearch runs in the stages'
+	}
+	local (lastpipe = 1)
+		assert {catch @ e {~ $e error} {yes | throw error pipe broken}} 'earlier stages are reaped after an exception'
+	assert {~ <={%apids} ()}
+}
+
+test 'lastpipe' {
+	local (x = 0) {
+		echo a | x = 1
+		assert {~ $x 0} 'the last stage runs in a child by default'
+		local (lastpipe = 1) {
+			echo a | x = <=%read
+			assert {~ $x a} 'lastpipe runs the last stage in this shell'
+			assert {~ <={%flatten ' ' <={/bin/false | true}} '1 0'} 'other stages still report status'
+			catch @ e {x = $e} {yes | throw error x}
+			assert {~ $x(2) x} 'exceptions escape the last stage'
+		}
+	}
+}
+
+test 'coprocess' {
+	let (c = <={%coproc cat}) {
+		%cosend $c hello world
+		%cosend $c again
+		assert {~ <={%coread $c} 'hello world'}
+		assert {~ <={%coread $c} again} 'responses are buffered in order'
+		assert {~ `^{catch @ e {echo $e(3)} {%coread $c}} *'parent shell'} 'the pipes do not leak into children'
+		assert {~ <={%coclose $c} 0}
+	}
+	let (c = <={%coproc echo -n last}) {
+		assert {~ <={%coread $c} last}
+		assert {~ <={%coread $c} ()} 'end of file'
+		%coclose $c
+	}
+	let (c = <={%coproc true}) {
+		%coclose $c
+		assert {!catch @ e {false} {%cosend $c hi; true}} 'closed coprocesses are gone'
+	}
+}
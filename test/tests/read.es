@@ -80,3 +80,90 @@ test 'fd error handling' {
 		assert {catch @ {false}  {$&readline <<< '' >[2=]; true}}
 	}
 }
+
+test 'readlines' {
+	let (tmp = `{mktemp test-lines.XXXXXX})
+	unwind-protect {
+		echo 'one
+two
+
+four' > $tmp
+		echo -n last >> $tmp
+		{
+			assert {~ <={%readlines 0 2} (one two)} 'lines come in groups'
+			assert {~ <={%readlines 0 10} ('' four last)} 'a final partial line is returned'
+			assert {~ <={%readlines 0 10} ()} 'end of file'
+		} < $tmp
+		assert {~ <={%readlines 0 1 < $tmp} one} 'a fresh open starts over'
+		assert {~ `{cat $tmp | {%readlines 0 1; cat}} ()} 'it reads ahead on pipes'
+		assert {~ `{cat $tmp | echo <={%readlines 0 2}} (one two)} 'pipes'
+		assert {~ `{cat $tmp | {echo <={%readlines 0 1}; echo <={%readlines 0 1}}} (one two)} 'a pipe keeps its reader'
+		assert {~ `{timeout 10 $es -c 'lastpipe = 1; yes | x = <={%readlines 0 1}; echo $x'} y} 'the writer sees the pipe close'
+		assert {catch @ {true} {%readlines 0 1 <[0=]; false}}
+	} {
+		rm -f $tmp
+	}
+}
+
+test 'readfile' {
+	let (tmp = `{mktemp test-readfile.XXXXXX})
+	unwind-protect {
+		echo 'one two
+three' > $tmp
+		assert {~ <={%readfile $tmp} 'one two
+three
+'} 'the whole file is one string'
+		assert {~ <={%readfile $tmp \n} ('one two' three)} 'split on newlines'
+		assert {~ <={%readfile $tmp ' '\n} (one two three)} 'split like backquote'
+		assert {~ `` \n {cat $tmp | $es -c 'echo <={%readfile /dev/stdin \n}'} 'one two three'} 'pipes are read'
+		printf 'a\0b\n' > $tmp
+		assert {~ <={%readfile $tmp} 'ab
+'} 'NULs are dropped'
+		rm -f $tmp
+		touch $tmp
+		assert {~ $#(<={%readfile $tmp}) 0} 'empty file'
+		assert {~ <={%readfile $tmp} `` '' {cat $tmp}} 'empty file, like backquote'
+		assert {~ <={%readfile $tmp \n} ()} 'empty file, split'
+		assert {catch @ {true} {%readfile /nonexistent/file; false}}
+	} {
+		rm -f $tmp
+	}
+}
+
+test 'script input' {
+	let (script = /tmp/es-script-$pid) {
+		echo 'echo a; x = <=%read
+line
+echo $x; head -1
+headline
+fn f {
+	echo b
+}
+f' > $script
+		assert {~ `{$es < $script} (a line headline b)} 'commands on shared input see the rest of the script'
+		assert {~ `{$es $script < /dev/null >[2] /dev/null} a} 'a sourced script is not shared'
+		echo 'x = <=%read
+line
+echo $x' > $script
+		assert {~ `{cat $script | $es /dev/stdin} line} 'a pipe opened by name is shared'
+		echo -n 'echo end' > $script
+		assert {~ `{$es $script} end} 'a missing final newline is supplied'
+		rm -f $script
+	}
+}
+
+test 'batch streaming' {
+	let (script = /tmp/es-stream-$pid.es) {
+		echo 'x = 1
+echo $x
+fn %parse {let (t = <={$&parse}) {echo parsed; result $t}}
+echo a
+fn-%parse = $&parse
+fn %dispatch cmd {echo dispatch; $cmd}
+echo b' > $script
+		assert {~ `{$es $script} (1 parsed a dispatch b)} 'hooks defined in a script apply to its later commands'
+		assert {~ `{$es -x $script >[2=1]} ('{x=1}' '{echo' '$x}' 1 *)} 'commands are traced under -x'
+		assert {~ `{$es -e -c 'false; echo no'} ()} '-e still exits on false'
+		rm -f $script
+	}
+}
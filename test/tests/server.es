@@ -0,0 +1,35 @@
+# tests/server.es -- verify that a server runs requests as its clients would
+
+test 'server mode' {
+	let (sock = /tmp/es-test-$pid.sock; fifo = /tmp/es-test-$pid.fifo) {
+		local (signals = $signals -sighup) $es -S $sock &
+		let (server = $apid) {
+			# the socket only appears once the server is listening
+			timeout 10 sh -c 'until test -S '^$sock^'; do sleep 0.01; done'
+			assert {access -s $sock} 'the server is listening'
+			assert {~ `^{$es -C $sock -c 'echo $* `{pwd}' a b} 'a b '^`{pwd}} 'the request runs with the client''s arguments and directory'
+			assert {~ <={$es -C $sock -c 'exit 3'} 3} 'the exit status comes back'
+			assert {~ `{echo hello | $es -C $sock -c 'cat'} hello} 'the client''s descriptors are used'
+			assert {~ `{ls -l $sock} srw-------*} 'only the owner can connect'
+			assert {!~ `{$es -C $sock -c 'echo $signals'} -sighup} 'the request does not get the server''s ignored signals'
+			local (signals = $signals -sighup)
+				assert {~ `{$es -C $sock -c 'echo $signals'} -sighup} 'the request gets the client''s ignored signals'
+
+			# the backquote ends when the request has exited, with its client gone
+			mkfifo $fifo.1 $fifo.2
+			let (out = `{
+				$es -C $sock -c '%readfile '^$fifo.1^'; %readfile '^$fifo.2^'; echo finished' &
+				timeout 10 sh -c 'echo > '^$fifo.1
+				kill -9 $apid
+				wait $apid >[2] /dev/null
+				timeout 10 sh -c 'echo > '^$fifo.2
+			})
+				assert {~ $out finished} 'a request outlives its client'
+			assert {~ `{$es -C $sock -c 'echo again'} again && kill -0 $server} 'a vanished client does not stop the server'
+			kill $server
+			wait $server >[2] /dev/null
+			rm -f $sock $fifo.1 $fifo.2
+		}
+	}
+	assert {~ `{$es -C /nonexistent/es.sock -c 'echo local'} local} 'without a server the shell runs the command itself'
+}
@@ -0,0 +1,20 @@
+# tests/startup.es -- verify the startup timing log
+
+test 'startup times' {
+	let (log = /tmp/es-startup-$pid) {
+		local (ES_STARTUP_TIMES = $log) $es -c 'echo a; echo b' > /dev/null
+		let (phases = `` \n {awk -F\t '{print $2}' < $log}) {
+			assert {~ $phases(1) initconv} 'the first phase is initconv'
+			assert {~ $phases runinitial && ~ $phases initenv && ~ $phases firstcmd}
+			assert {~ $phases($#phases) total} 'the last line is the total'
+		}
+		assert {~ `{awk -F\t 'NF != 5' < $log} ()} 'every line has five fields'
+		rm -f $log
+		echo true > $log.es
+		local (ES_STARTUP_TIMES = $log) $es -c '. '^$log.es^'; sleep 0.2'
+		assert {~ `{awk -F\t '$2 == "firstcmd" && $3 >= 100000 {print "ok"}' < $log} ok} 'a nested parse does not end the first command'
+		rm -f $log $log.es
+		$es -c true
+		assert {!access -f $log} 'nothing is written when the variable is unset'
+	}
+}
@@ -54,6 +54,20 @@ test 'syntactic sugar' {
 	}
 }
 
+test 'sequences and literal words' {
+	let (r = ()) {
+		let (fn-%seq = @ {r = $r seq}) {
+			r = a; r = $r b
+		}
+		assert {~ $r seq} 'rebinding %seq is honored'
+		{r = c; {r = $r d; r = $r e}}; r = $r f
+		assert {~ $r (c d e f)} 'nested sequences run in order'
+	}
+	assert {~ abc a^*} 'unquoted wildcards survive concatenation'
+	assert {! ~ abc a^'*'} 'quoted wildcards survive concatenation'
+	assert {~ 'a*' a^'*'} 'concatenated words are joined'
+}
+
 test 'readfrom/writeto sugar' {
 	for ((have want) = (
 		'cmd1 >{ cmd2 }' '%writeto _devfd0 {cmd2} {cmd1 $_devfd0}'
@@ -169,3 +183,72 @@ test 'bad %closures' {
 		}
 	}
 }
+
+test 'self-append assignment' {
+	local (x = a; y = ()) {
+		x = $x b
+		y = $x
+		x = $x c d
+		assert {~ $^x 'a b c d'} 'appends in order'
+		assert {~ $^y 'a b'} 'earlier copies are unaffected'
+		local (x = z) x = $x y
+		assert {~ $^x 'a b c d'} 'local restores the old value'
+		x = $x e
+		assert {~ $^x 'a b c d e'} 'append after local'
+	}
+	let (x = a) {
+		x = $x b
+		assert {~ $^x 'a b'} 'lexical variables append'
+	}
+	local (x = a; set-x = @ {result $* s}) {
+		x = $x b
+		assert {~ $^x 'a b s'} 'settor functions are called'
+	}
+	local (x = a) {
+		x = $x <={x = q; result r}
+		assert {~ $^x 'a r'} 'old value is read before items are evaluated'
+	}
+	local (x = ()) {
+		x = $x
+		x = $x $nothing
+		assert {~ $#x 0} 'appending nothing to nothing'
+		x = $x a
+		assert {~ $x a} 'appending to an empty variable'
+	}
+	assert {~ `{$es -c 'prompt = $prompt more; printenv prompt'} *more} 'appending to an initial variable exports it'
+}
+
+test 'subscripts' {
+	local (x = a b c d e) {
+		assert {~ <={%flatten ' ' $x(2)} b}
+		assert {~ <={%flatten ' ' $x(4 2)} 'd b'} 'subscripts can go backwards'
+		assert {~ <={%flatten ' ' $x(4 ...)} 'd e'} 'open ranges run to the end'
+		assert {~ <={%flatten ' ' $x(... 2)} 'a b'}
+		assert {~ <={%flatten ' ' $x(3 ... 9)} 'c d e'} 'ranges stop at the end of the list'
+		assert {~ <={%flatten ' ' $x(7)} ''}
+		x = $x f
+		assert {~ <={%flatten ' ' $x(6)} f} 'subscripts see appended elements'
+		x = q r
+		assert {~ <={%flatten ' ' $x(2)} r} 'subscripts see new values'
+		local (x = s t u) assert {~ <={%flatten ' ' $x(3)} u}
+		assert {~ <={%flatten ' ' $x(1)} q}
+	}
+}
+
+test 'backquote' {
+	local (x = a b c; fn f {echo f $*}) {
+		assert {~ `^{echo $x} 'a b c'}
+		assert {~ `^{f `{echo nested}} 'f nested'} 'nested backquotes'
+		assert {~ `^{for (i = 1 2) if {~ $i 2} {echo two}} two}
+		assert {~ `{result 3} () && ~ $bqstatus 3} 'status comes from the result'
+		x = `{x = changed; echo $x}
+		assert {~ $x changed}
+		`{x = unchanged}
+		assert {~ $x changed} 'assignments stay in the backquote'
+		let (c = {x = leaked}) {
+			`{if $c {echo hi}}
+			`{if {~ a a} $c}
+			assert {~ $x changed} 'code in variables stays in the backquote'
+		}
+	}
+}
@@ -220,6 +220,12 @@ EOF
 		{
 			assert {~ `` '' {cat <[0=9]} `` '' cat} 'large herestrings'
 		} < $bigfile
+		let (s = 0123456789) {
+			for (i = 1 2 3 4)
+				s = $s$s$s$s$s$s$s$s
+			assert {~ `` '' {cat <<< $s} $s} 'herestrings beyond a pipe buffer'
+			assert {$es -c 'access -f /dev/stdin' <<< $s} 'large herestrings are files'
+		}
 	} {
 		rm -f $bigfile
 	}
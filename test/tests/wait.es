@@ -38,3 +38,91 @@ test 'setpgid' {
 		assert {!{ps -o pid | grep $pid}}
 	}
 }
+
+test 'wait for sets' {
+	let (a = <={$&background {result 3}}; b = <={$&background {result 4}}) {
+		assert {~ <={%flatten ' ' <={wait $b $a}} '4 3'} 'wait returns statuses in order'
+		assert {~ <=%apids ()}
+	}
+	let (a = <={$&background {./testrun s}}; b = <={$&background {result 5}}) {
+		let ((status pid) = <={wait -n $a $b}) {
+			assert {~ $status 5 && ~ $pid $b} 'wait -n returns the first to exit'
+		}
+		assert {~ <=%apids $a}
+		kill $a
+		wait $a >[2] /dev/null
+	}
+}
+
+if {access -w /proc/sys/kernel/ns_last_pid} {
+	test 'reused pids' {
+		let (a = <={$&background {result 3}}) {
+			sleep 0.1
+			let (prev = `{expr $a - 1}) {
+				echo $prev > /proc/sys/kernel/ns_last_pid
+				let (b = <={$&background {./testrun s}}) {
+					if {~ $a $b} {
+						assert {~ <=%apids $b} 'a reused pid replaces the dead child'
+					}
+					kill $b
+					assert {~ <={wait $b >[2] /dev/null} sigterm}
+					assert {!~ <=%apids $b} 'a reused pid is waited for once'
+				}
+			}
+		}
+	}
+}
+
+test 'parallel' {
+	assert {~ <={%flatten ' ' <={%parallel -j 2 {result 1} {result 2} {result 3}}} '1 2 3'} 'statuses come back in order'
+	let (r = <={%parallel -o -j 3 {sleep 0.2; echo a} {echo b} {echo c; result 4}}) {
+		assert {~ <={%flatten ' ' $r(1 ... 3)} '0 0 4'}
+		assert {~ $r(4 ... 6) a\n b\n c\n} 'outputs follow the statuses in order'
+	}
+	assert {~ <=%apids ()} 'parallel jobs are all waited for'
+	let (parent = $pid; f = /tmp/parallel-$pid) local (signals = $signals sigusr1) {
+		catch @ e {
+			assert {~ $e signal sigusr1}
+		} {
+			%parallel -j 2 {exec sh -c 'echo $$ > '$f'; exec sleep 5'} {sleep 0.5; kill -USR1 $parent; exec sleep 5}
+		}
+		assert {!kill -0 `{cat $f} >[2] /dev/null} 'interrupted jobs are killed and reaped'
+		rm -f $f
+	}
+}
+
+test 'pmap' {
+	assert {~ <={%flatten ' ' <={%pmap -j 2 @ x {result $x$x} a b c}} 'aa bb cc'} 'results come back in order'
+	assert {~ <={%pmap -j 3 @ {result 'a b' ''} x y} ('a b' '' 'a b' '')} 'strings are passed intact'
+	assert {~ <={%pmap @ {result} a b} ()}
+	let (e = <={catch @ e {result $e} {%pmap -j 2 @ x {if {~ $x b c} {throw error $x} {result $x}} a b c}}) {
+		assert {~ $e(2) b} 'the first exception is rethrown'
+	}
+	assert {~ <=%apids ()} 'pmap workers are all waited for'
+	if {access -d /proc/self/fd} {
+		assert {~ <={%pmap -j 2 @ {result `{ls /proc/self/fd}} a b} (0 1 2 3 0 1 2 3)} 'pmap pipes do not leak into commands'
+	}
+	let (parent = $pid; start = `{date +%s}) local (signals = $signals sigusr1) {
+		catch @ e {
+			assert {~ $e signal sigusr1}
+		} {
+			%pmap -j 2 @ x {if {~ $x a} {sleep 0.5; kill -USR1 $parent}; sleep 30 > /dev/null >[2=1]} a b
+		}
+		assert {~ `{expr `{date +%s} - $start '<' 10} 1} 'interrupted workers are stopped, not waited out'
+	}
+}
+
+if {~ <=$&primitives usage} {
+	test 'job usage' {
+		./testrun 0 > /dev/null
+		let (u = <=%usage) {
+			assert {~ $#u 6} 'usage has six fields'
+			assert {!~ $u(3) 0} 'peak memory of the last job is recorded'
+		}
+		let (pid = <={$&background {./testrun 0 > /dev/null}}) {
+			wait $pid
+			let (u = <=%usage)
+				assert {!~ $u(3) 0} 'wait records the usage of what it waited for'
+		}
+	}
+}
@@ -14,10 +14,15 @@ static Tree *gmk(void *(*alloc)(size_t, Tag *), NodeKind t, va_list ap) {
 	switch (t) {
 	    default:
 		panic("mk: bad node kind %d", t);
-	    case nWord: case nQword: case nPrim:
+	    case nWord: case nQword:
 		n = alloc(offsetof(Tree, u[1]), &Tree1Tag);
 		n->u[0].s = va_arg(ap, char *);
 		break;
+	    case nPrim:
+		n = alloc(offsetof(Tree, u[2]), &Tree2Tag);
+		n->u[0].s = va_arg(ap, char *);
+		n->u[1].prim = lookupprim(n->u[0].s);
+		break;
 	    case nCall: case nThunk: case nVar:
 		n = alloc(offsetof(Tree, u[1]), &Tree1Tag);
 		n->u[0].p = va_arg(ap, Tree *);
@@ -89,7 +94,7 @@ static size_t Tree1Scan(void *p) {
 	switch (n->kind) {
 	    default:
 		panic("Tree1Scan: bad node kind %d", n->kind);
-	    case nPrim: case nWord: case nQword:
+	    case nWord: case nQword:
 		n->u[0].s = forward(n->u[0].s);
 		break;
 	    case nCall: case nThunk: case nVar:
@@ -108,8 +113,136 @@ static size_t Tree2Scan(void *p) {
 		n->u[0].p = forward(n->u[0].p);
 		n->u[1].p = forward(n->u[1].p);
 		break;
+	    case nPrim:	/* u[1].prim points to static data */
+		n->u[0].s = forward(n->u[0].s);
+		break;
 	    default:
 		panic("Tree2Scan: bad node kind %d", n->kind);
 	} 
 	return offsetof(Tree, u[2]);
 }
+
+
+#if HASHCONS
+/*
+ * hash-consing
+ *	sharetree() replaces each subtree of a newly sealed parse tree by
+ *	an identical one that is already live, if there is one.  since
+ *	children are shared first, two nodes are identical when their
+ *	kinds and child pointers are, or their strings for word nodes.
+ *	the table is weak:  sweeptrees() runs during each collection and
+ *	keeps only the nodes that survived.  sealed trees must therefore
+ *	never be modified in place.
+ */
+
+#define	INIT_SHARED_SIZE	1024
+
+static Tree **shared = NULL;
+static unsigned long nshared = 0, sharedsize = 0;
+
+/* mix -- fold a pointer into a hash value;  nodes are allocated near each other */
+static unsigned long mix(unsigned long n, void *p) {
+	n = (n ^ (unsigned long) p) * 0x9e3779b1UL;
+	return n ^ (n >> 15);
+}
+
+static unsigned long treehash(Tree *t) {
+	unsigned long n = t->kind;
+	const unsigned char *s;
+	switch (t->kind) {
+	    case nWord: case nQword: case nPrim:
+		for (s = (const unsigned char *) t->u[0].s; *s != '\0'; s++)
+			n = n * 31 + *s;
+		return mix(n, NULL);
+	    case nCall: case nThunk: case nVar:
+		return mix(n, t->u[0].p);
+	    default:
+		return mix(mix(n, t->u[0].p), t->u[1].p);
+	}
+}
+
+static Boolean treeequal(Tree *t1, Tree *t2) {
+	if (t1->kind != t2->kind)
+		return FALSE;
+	switch (t1->kind) {
+	    case nWord: case nQword: case nPrim:
+		return t1->u[0].s == t2->u[0].s || streq(t1->u[0].s, t2->u[0].s);
+	    case nCall: case nThunk: case nVar:
+		return t1->u[0].p == t2->u[0].p;
+	    default:
+		return t1->u[0].p == t2->u[0].p && t1->u[1].p == t2->u[1].p;
+	}
+}
+
+/* sharedslot -- find the slot holding (or to hold) a node like t */
+static Tree **sharedslot(Tree **table, unsigned long size, Tree *t) {
+	unsigned long n = treehash(t), mask = size - 1;
+	for (; table[n & mask] != NULL; n++)
+		if (treeequal(table[n & mask], t))
+			break;
+	return &table[n & mask];
+}
+
+/* rehash -- move the live entries of the table to a new one */
+static void rehash(unsigned long size, void *(*move)(void *)) {
+	unsigned long i;
+	Tree **table = ealloc(size * sizeof (Tree *));
+	memzero(table, size * sizeof (Tree *));
+	nshared = 0;
+	for (i = 0; i < sharedsize; i++) {
+		Tree *t = shared[i];
+		if (t != NULL && (t = (*move)(t)) != NULL) {
+			*sharedslot(table, size, t) = t;
+			nshared++;
+		}
+	}
+	if (shared != NULL)
+		efree(shared);
+	shared = table;
+	sharedsize = size;
+}
+
+static void *same(void *p) {
+	return p;
+}
+
+static Tree *share(Tree *t) {
+	Tree **slot;
+	if (t == NULL)
+		return NULL;
+	switch (t->kind) {
+	    case nWord: case nQword: case nPrim:
+		break;
+	    case nCall: case nThunk: case nVar:
+		t->u[0].p = share(t->u[0].p);
+		break;
+	    case nAssign:  case nConcat: case nClosure: case nFor:
+	    case nLambda: case nLet: case nList:  case nLocal:
+	    case nVarsub: case nMatch: case nExtract:
+		t->u[0].p = share(t->u[0].p);
+		t->u[1].p = share(t->u[1].p);
+		break;
+	    default:
+		return t;
+	}
+	if (nshared >= (sharedsize * 2) / 3)
+		rehash(sharedsize == 0 ? INIT_SHARED_SIZE : sharedsize * 2, same);
+	slot = sharedslot(shared, sharedsize, t);
+	if (*slot == NULL) {
+		*slot = t;
+		nshared++;
+	}
+	return *slot;
+}
+
+/* sharetree -- hash-cons a sealed parse tree */
+extern Tree *sharetree(Tree *tree) {
+	return share(tree);
+}
+
+/* sweeptrees -- drop nodes which did not survive a collection */
+extern void sweeptrees(void) {
+	if (shared != NULL)
+		rehash(sharedsize, weakforward);
+}
+#endif
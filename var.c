@@ -33,6 +33,7 @@ static Vector *env, *sortenv;
 static int envmin;
 static Boolean isdirty = TRUE;
 static Boolean rebound = TRUE;
+static Boolean importing = FALSE;	/* inside initenv() */
 
 DefineTag(Var, static);
 
@@ -57,6 +58,8 @@ static Var *mkvar(List *defn) {
 	var = gcnew(Var);
 	var->env = NULL;
 	var->defn = lp;
+	var->tail = NULL;
+	var->finger = NULL;
 	var->flags = hasbindings(lp) ? var_hasbindings : 0;
 	RefEnd(lp);
 	RefReturn(var);
@@ -71,6 +74,8 @@ static void *VarCopy(void *op) {
 static size_t VarScan(void *p) {
 	Var *var = p;
 	var->defn = forward(var->defn);
+	var->tail = forward(var->tail);
+	var->finger = forward(var->finger);
 	var->env = ((var->flags & var_hasbindings) && rebound) ? NULL : forward(var->env);
 	return sizeof (Var);
 }
@@ -141,7 +146,7 @@ extern List *varlookup(const char *name, Binding *bp) {
 
 	validatevar(name);
 	for (; bp != NULL; bp = bp->next)
-		if (streq(name, bp->name))
+		if (name == bp->name || streq(name, bp->name))
 			return bp->defn;
 
 	var = dictget(vars, name);
@@ -203,6 +208,8 @@ static void vardef0(char *name, Binding *binding, List *defn, Boolean startup) {
 	if (var != NULL)
 		if (defn != NULL) {
 			var->defn = defn;
+			var->tail = NULL;
+			var->finger = NULL;
 			var->env = NULL;
 			var->flags = hasbindings(defn) ? var_hasbindings : 0;
 		} else
@@ -211,6 +218,8 @@ static void vardef0(char *name, Binding *binding, List *defn, Boolean startup) {
 		var = mkvar(defn);
 		vars = dictput(vars, name, var);
 	}
+	if (importing && defn != NULL)
+		((Var *) dictget(vars, name))->flags |= var_isimported;
 	RefRemove(name);
 }
 
@@ -218,6 +227,82 @@ extern void vardef(char *name, Binding *binding, List *defn) {
 	vardef0(name, binding, defn, FALSE);
 }
 
+/*
+ * varindex -- return the cell holding element n (counting from 1) of
+ *	list, the definition of the named variable, or NULL if the list is
+ *	shorter than that.  for global variables the last cell found is
+ *	remembered, so stepping through a list with $x($i) does not start
+ *	from the head of the list every time.
+ */
+extern List *varindex(const char *name, Binding *binding, List *list, int n) {
+	int i = 1;
+	List *lp = list;
+	Var *var = NULL;
+
+	for (; binding != NULL; binding = binding->next)
+		if (streq(name, binding->name))
+			break;
+	if (binding == NULL && (var = dictget(vars, name)) != NULL && var->defn != list)
+		var = NULL;
+	if (var != NULL && var->finger != NULL && var->fingerpos <= n) {
+		lp = var->finger;
+		i = var->fingerpos;
+	}
+	for (; lp != NULL && i < n; i++)
+		lp = lp->next;
+	if (var != NULL && lp != NULL) {
+		var->finger = lp;
+		var->fingerpos = n;
+	}
+	return lp;
+}
+
+/*
+ * varappend -- add to the end of a global variable's definition,
+ *	as in `x = $x items', without copying the whole list each time.
+ *	the first append copies the old definition; after that, the
+ *	variable owns its list and later appends extend it in place.
+ *	returns NULL if vardef() must be used instead.
+ */
+extern List *varappend(char *name, Binding *binding, List *items) {
+	Var *var;
+
+	validatevar(name);
+	for (; binding != NULL; binding = binding->next)
+		if (streq(name, binding->name))
+			return NULL;
+	if (specialvar(name) || varlookup2("set-", name, NULL) != NULL)
+		return NULL;
+	var = dictget(vars, name);
+	if (var == NULL || (var->defn == NULL && items == NULL))
+		return NULL;
+
+	if (var->tail == NULL) {
+		List *lp;
+		Ref(char *, np, name);
+		Ref(List *, ip, items);
+		lp = append(var->defn, ip);
+		var = dictget(vars, np);
+		var->defn = lp;
+		items = ip;
+		name = np;
+		RefEnd2(ip, np);
+		var->tail = lp;
+		var->finger = NULL;
+	} else
+		var->tail->next = items;
+	for (; var->tail->next != NULL; var->tail = var->tail->next)
+		;
+
+	if (isexported(name))
+		isdirty = TRUE;
+	var->env = NULL;
+	var->flags &= ~(var_isinternal|var_isimported);
+	if (hasbindings(items))
+		var->flags |= var_hasbindings;
+	return var->defn;
+}
+
 extern void varpush(Push *push, char *name, List *defn) {
 	Var *var;
 
@@ -241,6 +326,8 @@ extern void varpush(Push *push, char *name, List *defn) {
 		push->defn	= var->defn;
 		push->flags	= var->flags;
 		var->defn	= defn;
+		var->tail	= NULL;
+		var->finger	= NULL;
 		var->env	= NULL;
 		var->flags	= hasbindings(defn) ? var_hasbindings : 0;
 	}
@@ -279,6 +366,8 @@ extern void varpop(Push *push) {
 	if (var != NULL)
 		if (push->defn != NULL) {
 			var->defn = push->defn;
+			var->tail = NULL;
+			var->finger = NULL;
 			var->flags = push->flags;
 			var->env = NULL;
 		} else
@@ -379,6 +468,12 @@ static void hide(void UNUSED *dummy, char UNUSED *key, void *value) {
 	((Var *) value)->flags |= var_isinternal;
 }
 
+/* isinternal -- is a variable still bound to its initial definition? */
+extern Boolean isinternal(const char *name) {
+	Var *var = dictget(vars, name);
+	return var != NULL && (var->flags & var_isinternal) != 0;
+}
+
 /* hidevariables -- mark all variables as internal */
 extern void hidevariables(void) {
 	dictforall(vars, hide, NULL);
@@ -549,13 +644,19 @@ extern int putenv(char *envstr) {
 }
 #endif
 
-/* initenv -- load variables from the environment */
+/*
+ * initenv -- load variables from the environment.  whatever is defined
+ *	here, including by settors, is marked as imported, so that an image
+ *	(see image.c) does not record it.
+ */
 extern void initenv(char **envp, Boolean protected) {
 	int i;
 	char *envstr;
 	size_t bufsize = 1024;
 	char *buf = ealloc(bufsize);
 
+	importing = TRUE;
+
 	Ref(Vector *, imported, mkvector(ENVSIZE));
 	Ref(char *, name, NULL);
 	for (; (envstr = *envp) != NULL; envp++) {
@@ -593,6 +694,7 @@ extern void initenv(char **envp, Boolean protected) {
 	RefEnd2(var, imported);
 	envmin = env->count;
 	efree(buf);
+	importing = FALSE;
 
 #if LOCAL_GETENV
 	realgetenv = esgetenv;
@@ -3,11 +3,15 @@
 typedef struct Var Var;
 struct Var {
 	List *defn;
+	List *tail;		/* last cell of defn, if varappend() may extend it */
+	List *finger;		/* cell last found by varindex() */
+	int fingerpos;		/* position of finger in defn, from 1 */
 	char *env;
 	int flags;
 };
 
 #define	var_hasbindings		1
 #define	var_isinternal		2
+#define	var_isimported		4
 
 extern Dict *vars;
@@ -6,3 +6,6 @@ static const Term
 	version_term = { VERSION, NULL };
 static const List versionstruct = { (Term *) &version_term, NULL };
 const List * const version = &versionstruct;
+
+/* identifies this build of the parser; see the version.o rule in Makefile.in */
+const char buildstamp[] = VERSION " " __DATE__ " " __TIME__;